@@ -1731,5 +1731,27 @@ namespace IR {
         return p;
     }
 
+    Program parse_string (const std::string & source, const std::string & sourceName){
+
+        /* 
+        * Check the grammar for some possible issues.
+        */
+        pegtl::analyze< grammar >();
+
+        /*
+        * Parse.
+        */   
+        memory_input< > memInput(source, sourceName);
+        Program p;
+        parse< grammar, action >(memInput, p);
+
+        if (p.mainF == NULL){
+            std::cerr << "missing main function" << '\n';
+            assert(0);
+        }
+    
+        return p;
+    }
+
 
 }
@@ -10,6 +10,27 @@
 namespace IR {
     const int32_t VAL_WIDTH = 8;
 
+    /**
+     *  card table of the runtime (see lib/runtime.c), at a fixed address:
+     *      the card of address a is the word at CARD_TABLE_ADDR + ((a >> 6) & CARD_OFFSET_MASK)
+     *      GC_BARRIER_FLAG_ADDR is set by programs that mark their cards
+     * */
+    const int64_t CARD_TABLE_ADDR = 1073741824;
+    const int64_t CARD_OFFSET_MASK = 524280;
+    const int64_t GC_BARRIER_FLAG_ADDR = 1074266112;
+
+    /**
+     *  nursery of the runtime, next to the barrier flag:
+     *      the words at NURSERY_TOP_ADDR/NURSERY_LIMIT_ADDR bound its free space
+     *      the start bit of address a is bit (a >> 3) & 63 of the bitmap word
+     *      at ((a >> 9) << 3) + the word at NURSERY_STARTS_BIAS_ADDR
+     *  tuples up to INLINE_TUPLE_MAX_FIELDS fields are allocated in place
+     * */
+    const int64_t NURSERY_TOP_ADDR = 1074266120;
+    const int64_t NURSERY_LIMIT_ADDR = 1074266128;
+    const int64_t NURSERY_STARTS_BIAS_ADDR = 1074266136;
+    const int64_t INLINE_TUPLE_MAX_FIELDS = 16;
+
     int64_t getEncoded(int64_t c) {
         return (c << 1) + 1;
     }
@@ -40,10 +61,24 @@ namespace IR {
         return v;
     }
 
+    ItemLabel * InstL3GenVisitor::get_new_label() {
+        ItemLabel * l = new ItemLabel(
+            newLabelPrefix + std::to_string(this->newLabelIdx)
+        );
+
+        this->newLabelIdx++;
+        this->newlabels.push_back(l);
+
+        return l;
+    }
+
     void InstL3GenVisitor::clean_new_vars() {
         for (ItemVariable * v: this->newvars) {
             delete v;
         }
+        for (ItemLabel * l: this->newlabels) {
+            delete l;
+        }
     }
 
 
@@ -51,15 +86,20 @@ namespace IR {
         this->out = NULL;
         this->newVarPrefix = "";
         this->newVarIdx = 0;
+        this->newLabelPrefix = "";
+        this->newLabelIdx = 0;
     }
 
     InstL3GenVisitor::InstL3GenVisitor(
-        std::ofstream * outputFile,
-        std::string & newVarPrefix
+        std::ostream * outputFile,
+        std::string & newVarPrefix,
+        std::string & newLabelPrefix
     ) {
         this->out = outputFile;
         this->newVarPrefix = newVarPrefix;
         this->newVarIdx = 0;
+        this->newLabelPrefix = newLabelPrefix;
+        this->newLabelIdx = 0;
     }
 
     void InstL3GenVisitor::visit(Instruction_label * lb) {
@@ -159,6 +199,14 @@ namespace IR {
          *  %t <- call allocate(newTuple->, 1) 
          * */
         ItemConstant constOne(1);
+
+        if (newTuple->len->itemtype == ItemType::item_constant) {
+            int64_t fieldNum = getDecoded(((ItemConstant *) newTuple->len)->constVal);
+            if (fieldNum >= 0 && fieldNum <= INLINE_TUPLE_MAX_FIELDS) {
+                this->output_inlineNewTupleInst(dst, newTuple, fieldNum);
+                return;
+            }
+        }
         
         std::string inst = "";
         inst += dst->to_string();
@@ -174,6 +222,129 @@ namespace IR {
         this->output_inst_tab(inst);
     }
 
+    void InstL3GenVisitor::output_inlineNewTupleInst(
+        Item * dst,
+        ItemNewTuple * newTuple,
+        int64_t fieldNum
+    ) {
+        /**
+         *  same layout as allocate: a tuple without fields still has one word
+         *
+         *  %top <- NURSERY_TOP_ADDR
+         *  %t <- load %top
+         *  %end <- %t + words * 8
+         *  %limit <- NURSERY_LIMIT_ADDR
+         *  %limit <- load %limit
+         *  %fits <- %end <= %limit
+         *  br %fits :fast
+         *  %t <- call allocate(len, 1)
+         *  br :done
+         *  :fast
+         *  store %top <- %end
+         *  store %t <- fieldNum
+         *  store %t + 8 * i <- 1     for every field
+         *  %bit <- %t >> 3
+         *  %bit <- %bit & 63
+         *  %bit <- 1 << %bit
+         *  %startWord <- %t >> 9
+         *  %startWord <- %startWord << 3
+         *  %bias <- NURSERY_STARTS_BIAS_ADDR
+         *  %bias <- load %bias
+         *  %startWord <- %startWord + %bias
+         *  %starts <- load %startWord
+         *  %starts <- %starts + %bit   the bits of free space are clear
+         *  store %startWord <- %starts
+         *  :done
+         * */
+        int64_t words = (fieldNum == 0) ? 2 : fieldNum + 1;
+
+        ItemVariable * top = this->get_new_var();
+        ItemVariable * end = this->get_new_var();
+        ItemVariable * limit = this->get_new_var();
+        ItemVariable * fits = this->get_new_var();
+        ItemLabel * fastLabel = this->get_new_label();
+        ItemLabel * doneLabel = this->get_new_label();
+
+        ItemConstant topAddr(NURSERY_TOP_ADDR);
+        ItemConstant limitAddr(NURSERY_LIMIT_ADDR);
+        ItemConstant objBytes(words * VAL_WIDTH);
+
+        this->output_AssignInst(top, &topAddr);
+        this->output_LoadInst(dst, top);
+        this->output_operatorInst(end, dst, OpType::plus, &objBytes);
+        this->output_AssignInst(limit, &limitAddr);
+        this->output_LoadInst(limit, limit);
+        this->output_operatorInst(fits, end, OpType::leq, limit);
+        this->output_branchInst(fits, fastLabel);
+
+        std::string inst = "";
+        inst += dst->to_string();
+        inst += " <- call allocate(";
+        inst += newTuple->len->to_string();
+        inst += ", 1)\n";
+        this->output_inst_tab(inst);
+        this->output_branchInst(NULL, doneLabel);
+
+        this->output_labelInst(fastLabel);
+        this->output_StoreInst(top, end);
+
+        ItemConstant header(fieldNum);
+        ItemConstant fill(1);
+        this->output_StoreInst(dst, &header);
+
+        ItemVariable * field = this->get_new_var();
+        ItemConstant width(VAL_WIDTH);
+        this->output_AssignInst(field, dst);
+        for (int64_t i = 1; i < words; i++) {
+            this->output_operatorInst(field, field, OpType::plus, &width);
+            this->output_StoreInst(field, &fill);
+        }
+
+        ItemVariable * bit = this->get_new_var();
+        ItemVariable * startWord = this->get_new_var();
+        ItemVariable * bias = this->get_new_var();
+        ItemVariable * starts = this->get_new_var();
+        ItemConstant wordShift(3);
+        ItemConstant bitMask(63);
+        ItemConstant startWordShift(9);
+        ItemConstant biasAddr(NURSERY_STARTS_BIAS_ADDR);
+
+        this->output_operatorInst(bit, dst, OpType::shift_right, &wordShift);
+        this->output_operatorInst(bit, bit, OpType::bit_and, &bitMask);
+        this->output_operatorInst(bit, &fill, OpType::shift_left, bit);
+        this->output_operatorInst(startWord, dst, OpType::shift_right, &startWordShift);
+        this->output_operatorInst(startWord, startWord, OpType::shift_left, &wordShift);
+        this->output_AssignInst(bias, &biasAddr);
+        this->output_LoadInst(bias, bias);
+        this->output_operatorInst(startWord, startWord, OpType::plus, bias);
+        this->output_LoadInst(starts, startWord);
+        this->output_operatorInst(starts, starts, OpType::plus, bit);
+        this->output_StoreInst(startWord, starts);
+
+        this->output_labelInst(doneLabel);
+    }
+
+    void InstL3GenVisitor::output_labelInst(ItemLabel * label) {
+        std::string inst = label->to_string();
+        inst += "\n";
+        this->output_inst_tab(inst);
+    }
+
+    void InstL3GenVisitor::output_branchInst(Item * cond, ItemLabel * label) {
+        /**
+         *  br cond label
+         *  br label            when @cond is NULL
+         * */
+        std::string inst = "br ";
+        if (cond != NULL) {
+            inst += cond->to_string();
+            inst += " ";
+        }
+        inst += label->to_string();
+        inst += "\n";
+        this->output_inst_tab(inst);
+    }
+
     void InstL3GenVisitor::output_newArrayInst(
         Item * dst,
         ItemNewArray * newArr
@@ -409,6 +580,58 @@ namespace IR {
         inst += src->to_string();
         inst += "\n";
         this->output_inst_tab(inst);
+
+        /**
+         *  only tuples and tensors can point into the nursery
+         * */
+        if (src->itemtype != ItemType::item_variable) return;
+        Item * srcType = ((ItemVariable *) src)->typeSig;
+        if (srcType == NULL || srcType->itemtype != ItemType::item_type_sig) return;
+
+        VarType vtype = ((ItemTypeSig *) srcType)->vtype;
+        if (vtype == VarType::tuple || vtype == VarType::tensor) {
+            this->output_writeBarrier(addr);
+        }
+    }
+
+    void InstL3GenVisitor::output_writeBarrier(Item *addr) {
+        /**
+         *  %card <- addr >> 6
+         *  %card <- %card & CARD_OFFSET_MASK
+         *  %card <- %card + CARD_TABLE_ADDR
+         *  store %card <- 1
+         * */
+        ItemVariable * card = this->get_new_var();
+        ItemConstant cardShift(6);
+        ItemConstant cardMask(CARD_OFFSET_MASK);
+        ItemConstant cardTable(CARD_TABLE_ADDR);
+
+        this->output_operatorInst(card, addr, OpType::shift_right, &cardShift);
+        this->output_operatorInst(card, card, OpType::bit_and, &cardMask);
+        this->output_operatorInst(card, card, OpType::plus, &cardTable);
+
+        std::string inst = "";
+        inst += "store ";
+        inst += card->to_string();
+        inst += " <- 1\n";
+        this->output_inst_tab(inst);
+    }
+
+    void InstL3GenVisitor::output_barrierFlag() {
+        /**
+         *  %flag <- GC_BARRIER_FLAG_ADDR
+         *  store %flag <- 1
+         * */
+        ItemVariable * flag = this->get_new_var();
+        ItemConstant flagAddr(GC_BARRIER_FLAG_ADDR);
+
+        this->output_AssignInst(flag, &flagAddr);
+
+        std::string inst = "";
+        inst += "store ";
+        inst += flag->to_string();
+        inst += " <- 1\n";
+        this->output_inst_tab(inst);
     }
 
     
@@ -834,6 +1057,32 @@ namespace IR {
         return longest;
     }
 
+    std::string find_longest_label (Program & p) {
+        std::string longest = "";
+        int32_t len = 0;
+
+        for (Function * F: p.functions) {
+            for (auto & kv : F->labelName2ptr) {
+                int32_t l = kv.first.length();
+                if (l > len) {
+                    longest = kv.first;
+                    len = l;
+                }
+            }
+        }
+
+        return longest;
+    }
+
+    std::string new_label_prefix(Program & p) {
+        std::string LL = find_longest_label(p);
+        if (LL.size() == 0) {
+            LL = ":";
+        }
+
+        return LL + "_new_";
+    }
+
     std::string new_var_prefix(Program & p) {
         std::string LV =  find_longest_var(p);
         if (LV.size() == 0) {
@@ -846,7 +1095,7 @@ namespace IR {
     /**
      *  arg0, arg1, arg2
      * */
-    void output_args_helper(std::ofstream & out, std::vector<Item *> & args) {
+    void output_args_helper(std::ostream & out, std::vector<Item *> & args) {
         for (int32_t i = 0; i < args.size(); i++) {
             if (i > 0) {
                 out << ", ";
@@ -856,10 +1105,15 @@ namespace IR {
         }
     }
 
-    generateCodeForTraces::generateCodeForTraces(std::ofstream * outputFile, std::string & newVarPrefix) {
+    generateCodeForTraces::generateCodeForTraces(
+        std::ostream * outputFile,
+        std::string & newVarPrefix,
+        std::string & newLabelPrefix
+    ) {
         
-        this->L3InstGen = InstL3GenVisitor(outputFile, newVarPrefix);
+        this->L3InstGen = InstL3GenVisitor(outputFile, newVarPrefix, newLabelPrefix);
         this->out = outputFile;
+        this->needBarrierFlag = false;
     }
 
     bool canMerge(BasicBlock * curBB, BasicBlock * nextBB) {
@@ -903,6 +1157,10 @@ namespace IR {
 
     }
 
+    void generateCodeForTraces::generateBarrierFlag() {
+        this->needBarrierFlag = true;
+    }
+
     void generateCodeForTraces::generateL3code(std::vector<Trace *> & traces) {
         
         for (Trace * tr : traces) {
@@ -918,6 +1176,14 @@ namespace IR {
                     curBB->label->accept(this->L3InstGen);
                 }
 
+                /**
+                 *  L3 wants the entry label first
+                 * */
+                if (this->needBarrierFlag) {
+                    this->L3InstGen.output_barrierFlag();
+                    this->needBarrierFlag = false;
+                }
+
                 for (Instruction * inst : curBB->insts) {
                     inst->accept(this->L3InstGen);
                 }
@@ -977,13 +1243,12 @@ namespace IR {
     // }
 
     void generateCode(
-        Program & p
+        Program & p,
+        std::ostream & out
     ) {
         std::string varPrefix = new_var_prefix(p);
+        std::string labelPrefix = new_label_prefix(p);
 
-        std::ofstream out =  std::ofstream();
-        out.open("prog.L3");
-        
         for (Function * F : p.functions) {
             out << "define ";
             out << F->name->to_string();
@@ -995,15 +1260,27 @@ namespace IR {
             out << "{\n";
 
             std::vector<Trace *> traces = runGenerateTrace(F);            
-            generateCodeForTraces traceCodeGen(&out, varPrefix);
+            generateCodeForTraces traceCodeGen(&out, varPrefix, labelPrefix);
+            if (F->name->to_string() == ":main") {
+                traceCodeGen.generateBarrierFlag();
+            }
             traceCodeGen.generateL3code(traces);
 
             out << "}\n";
 
         }
 
-        out.close();
+    }
 
+    void generateCode(
+        Program & p
+    ) {
+        std::ofstream out =  std::ofstream();
+        out.open("prog.L3");
+
+        generateCode(p, out);
+
+        out.close();
     }
 }
 
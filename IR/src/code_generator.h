@@ -15,6 +15,7 @@
 namespace IR {
 
     void generateCode(Program & p);
+    void generateCode(Program & p, std::ostream & out);
 
     class InstL3GenVisitor : public InstVisitor {
         public:
@@ -36,17 +37,31 @@ namespace IR {
             void visit(Instruction_assignment *)    override;
 
             InstL3GenVisitor();
-            InstL3GenVisitor(std::ofstream * outputFile, std::string & newVarPrefix);
+            InstL3GenVisitor(
+                std::ostream * outputFile,
+                std::string & newVarPrefix,
+                std::string & newLabelPrefix
+            );
 
             void clean_new_vars();
+
+            /**
+             *  tell the runtime that this program marks cards on pointer stores,
+             *      so it can collect its nursery on its own
+             * */
+            void output_barrierFlag();
         private:
             ItemVariable * get_new_var();
+            ItemLabel * get_new_label();
 
             
 
-            std::ofstream *out;
+            std::ostream *out;
             std::string newVarPrefix;
             int32_t newVarIdx;
+            std::string newLabelPrefix;
+            int32_t newLabelIdx;
+            std::vector<ItemLabel *> newlabels;
 
             std::vector<ItemVariable *> newvars;
 
@@ -82,6 +97,19 @@ namespace IR {
                 ItemNewTuple * newTuple
             );
 
+            /**
+             *  bump @dst out of the nursery of the runtime without calling allocate,
+             *      allocate only runs when the nursery is full
+             * */
+            void output_inlineNewTupleInst(
+                Item * dst,
+                ItemNewTuple * newTuple,
+                int64_t fieldNum
+            );
+
+            void output_labelInst(ItemLabel * label);
+            void output_branchInst(Item * cond, ItemLabel * label);
+
             void output_AssignCallInst(
                 Item * dst,
                 ItemCall * call
@@ -114,6 +142,11 @@ namespace IR {
                 Item *addr
             );
 
+            /**
+             *  mark the card of @addr after a tuple/tensor was stored there
+             * */
+            void output_writeBarrier(Item *addr);
+
             
             
             
@@ -124,10 +157,20 @@ namespace IR {
         public:
             void generateL3code(std::vector<Trace *> & traces);
 
-            generateCodeForTraces(std::ofstream * outputFile, std::string & newVarPrefix);
+            /**
+             *  emit the barrier flag of the runtime at the entry of the next function
+             * */
+            void generateBarrierFlag();
+
+            generateCodeForTraces(
+                std::ostream * outputFile,
+                std::string & newVarPrefix,
+                std::string & newLabelPrefix
+            );
 
         private:
             InstL3GenVisitor L3InstGen;
-            std::ofstream *out;
+            std::ostream *out;
+            bool needBarrierFlag;
     }; 
 }
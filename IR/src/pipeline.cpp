@@ -0,0 +1,15 @@
+#include "pipeline.h"
+#include "IRparser.h"
+#include "code_generator.h"
+
+namespace IR {
+
+    void compile_source(const std::string & source, const std::string & sourceName, std::ostream & out){
+        auto p = IR::parse_string(source, sourceName);
+
+        p.populatePredsSuccs();
+
+        IR::generateCode(p, out);
+    }
+
+}
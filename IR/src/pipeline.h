@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <ostream>
+
+namespace IR {
+
+    /*
+     * Linearize the IR program held in @source into traces and write the resulting L3 program to @out.
+     * Used by the single-process driver; @sourceName is only used in parse errors.
+     */
+    void compile_source(const std::string & source, const std::string & sourceName, std::ostream & out);
+
+}
@@ -3,6 +3,7 @@
 #include <fstream>
 
 #include <code_generator.h>
+#include <stack_map.h>
 
 #define QUADSIZE 8
 #define REG_ARGS_NUM 6
@@ -36,7 +37,7 @@ namespace L1{
     }
     
   }
-  void output_8bregister(std::ofstream & out, Register_8b_type rtype) {
+  void output_8bregister(std::ostream & out, Register_8b_type rtype) {
     out << '%';
     switch(rtype) {
       case r10b : 
@@ -90,7 +91,7 @@ namespace L1{
     }
   }
 
-  void output_register(std::ofstream & out, Register_type rtype) {
+  void output_register(std::ostream & out, Register_type rtype) {
     out << '%';
     switch(rtype) {
       case rdi : 
@@ -159,7 +160,7 @@ namespace L1{
     }
   }
 
-  void output_set_cmp(std::ofstream & out, CmpType cmptype){
+  void output_set_cmp(std::ostream & out, CmpType cmptype){
     switch(cmptype) {
           case CmpType::less:
             out << "setl";
@@ -186,7 +187,7 @@ namespace L1{
         }
   }
 
-  void output_jmp_cmp(std::ofstream & out, CmpType cmptype){
+  void output_jmp_cmp(std::ostream & out, CmpType cmptype){
     switch(cmptype) {
           case CmpType::less:
             out << "jl";
@@ -213,18 +214,18 @@ namespace L1{
         }
   }
 
-  void output_constant(std::ofstream & out, int64_t val) {
+  void output_constant(std::ostream & out, int64_t val) {
     out << '$' << val;
   }
 
-  void output_memmory_access(std::ofstream & out, Register_type rType, int64_t offset){
+  void output_memmory_access(std::ostream & out, Register_type rType, int64_t offset){
     out << offset;
     out << '(' ;
     output_register(out, rType);
     out << ')' ;
   }
 
-  void output_item_labels(std::ofstream & out, std::string & labelName) {
+  void output_item_labels(std::ostream & out, std::string & labelName) {
     out << "$_";
     out << labelName.substr(1, labelName.length() - 1);
   }
@@ -232,7 +233,7 @@ namespace L1{
   /**
    *  output jmp style label
    */
-  void output_jmp_labels(std::ofstream & out, std::string & labelName) {
+  void output_jmp_labels(std::ostream & out, std::string & labelName) {
     out << "_";
     out << labelName.substr(1, labelName.length() - 1);
   }
@@ -240,31 +241,31 @@ namespace L1{
   /**
    *  Wrapper of jmp instruction output
    * */
-  void output_jmp_inst(std::ofstream & out, ItemLabel * itLabel) {
+  void output_jmp_inst(std::ostream & out, ItemLabel * itLabel) {
     out << "jmp ";
     output_jmp_labels(out, itLabel->labelName);
     out << '\n';
   }
 
-  // void output_item_cmp(std::ofstream & out, ItemCmp * cmp) {
+  // void output_item_cmp(std::ostream & out, ItemCmp * cmp) {
   //   output_item(cmp->op1)
   // }
 
-  void empty_lines(std::ofstream & out, int count) {
+  void empty_lines(std::ostream & out, int count) {
     while(count-- > 0) {
       out << '\n';
     }
   }
 
 
-  void output_header(std::ofstream & out){
+  void output_header(std::ostream & out){
     out << ".text\n";
     out << "  .globl go\n";
     out << "go:\n";
   }
 
 
-  void push_caller_save(std::ofstream & out) {
+  void push_caller_save(std::ostream & out) {
     out << "pushq %rbx\n";
     out << "pushq %rbp\n";
     out << "pushq %r12\n";
@@ -274,13 +275,13 @@ namespace L1{
   }
 
 
-  void call_entryPoint(std::ofstream & out, Program & p) {
+  void call_entryPoint(std::ostream & out, Program & p) {
     out << "call _"; 
     out << p.entryPointLabel.substr(1, p.entryPointLabel.length() - 1);
     out << '\n';
   }
 
-  void pop_caller_save(std::ofstream & out) {
+  void pop_caller_save(std::ostream & out) {
     out << "popq %rbx\n";
     out << "popq %rbp\n";
     out << "popq %r12\n";
@@ -289,18 +290,18 @@ namespace L1{
     out << "popq %r15\n";
   }
 
-  void output_ret(std::ofstream & out) {
+  void output_ret(std::ostream & out) {
     out << "retq\n";
   }
 
-  void output_label_def(std::ofstream & out, std::string & labelname){
+  void output_label_def(std::ostream & out, std::string & labelname){
     out << "_"; 
     out << labelname.substr(1, labelname.length() - 1);
     out << ':';
     out << '\n';
   }
 
-  void output_item(std::ofstream & out, Item * it){
+  void output_item(std::ostream & out, Item * it){
     switch (it->itemtype) {
       case ItemType::item_registers:
       {
@@ -390,7 +391,7 @@ namespace L1{
     }
   }
 
-  void output_movzbq(std::ofstream & out, Register_type rtype) {
+  void output_movzbq(std::ostream & out, Register_type rtype) {
     out << "movzbq ";
     
     output_8bregister(out, find_8b_equivalent(rtype));
@@ -402,7 +403,7 @@ namespace L1{
     out << '\n';
   }
 
-  void output_inst_assign(std::ofstream & out, Instruction_assignment * assign){
+  void output_inst_assign(std::ostream & out, Instruction_assignment * assign){
     /**
      *  dest <- src  ==>> movq src dest
      **/
@@ -493,7 +494,7 @@ namespace L1{
     out << "\n";
   }
 
-  void stack_grow(std::ofstream & out, int bytes) {
+  void stack_grow(std::ostream & out, int bytes) {
     out << "subq ";
     out << '$';
     out << bytes;
@@ -501,7 +502,7 @@ namespace L1{
     out << "%rsp\n";
   }
 
-  void stack_shrink(std::ofstream & out, int bytes) {
+  void stack_shrink(std::ostream & out, int bytes) {
     out << "addq ";
     out << '$';
     out << bytes;
@@ -510,14 +511,14 @@ namespace L1{
   }
 
 
-  void alloc_locals(std::ofstream & out, Function * function){
+  void alloc_locals(std::ostream & out, Function * function){
     int growedQuad = function->locals;
     if (growedQuad > 0) {
       stack_grow(out, growedQuad * QUADSIZE);
     }
   }
 
-  void dealloc_locals_and_stack(std::ofstream & out, Function * function) {
+  void dealloc_locals_and_stack(std::ostream & out, Function * function) {
     int numLocals = function->locals;
     int numArgsOnStack = MAX(function->arguments - REG_ARGS_NUM, 0);
     
@@ -527,7 +528,7 @@ namespace L1{
     }
   }
 
-  void output_runtimeCall(std::ofstream & out, Instruction_call_runtime * runtime_call) {
+  void output_runtimeCall(std::ostream & out, Instruction_call_runtime * runtime_call) {
     out << "call ";
     if (runtime_call->callee == "tensor-error") {
       switch (runtime_call->arg_cnt)
@@ -553,7 +554,7 @@ namespace L1{
     out << '\n';
   }
 
-  void output_userCall(std::ofstream & out, Instruction_call_user * user_call) {
+  void output_userCall(std::ostream & out, Instruction_call_user * user_call) {
     int quadToGrow = 1;
     ItemConstant * c = (ItemConstant * ) user_call->num_args;
     quadToGrow += MAX(c->constVal - REG_ARGS_NUM, 0);
@@ -584,7 +585,7 @@ namespace L1{
     out << '\n';
   }
 
-  void output_call_inst(std::ofstream & out, Instruction_call * call) {
+  void output_call_inst(std::ostream & out, Instruction_call * call) {
 
     if (call->isRuntimeCall) {
 
@@ -598,7 +599,7 @@ namespace L1{
     }
   }
 
-  void output_aop_inst(std::ofstream & out, Instruction_aop * aop) {
+  void output_aop_inst(std::ostream & out, Instruction_aop * aop) {
     /**
      *  op1 += op2  ==>> addq op2 op1
      * */
@@ -633,7 +634,7 @@ namespace L1{
     out << '\n';
   }
   
-  void output_sop_inst(std::ofstream & out, Instruction_sop * sop) {
+  void output_sop_inst(std::ostream & out, Instruction_sop * sop) {
     /**
      *  op1 >>= op2  ==>> sarq op2 op1
      * */
@@ -671,7 +672,7 @@ namespace L1{
     out << '\n';
   }
 
-  void output_lea_inst(std::ofstream & out, Instruction_lea * lea) {
+  void output_lea_inst(std::ostream & out, Instruction_lea * lea) {
     /**
      *  rax @ rdi rsi 4  ==>> lea (%rdi, %rsi, 4), %rax
      * */
@@ -698,7 +699,7 @@ namespace L1{
     out << '\n';
   }
   
-  void output_goto_inst(std::ofstream & out, Instruction_goto * goto_inst) {
+  void output_goto_inst(std::ostream & out, Instruction_goto * goto_inst) {
     /**
      *  goto :label  ==>> jmp _label
      * */
@@ -709,7 +710,7 @@ namespace L1{
     out << '\n';
   }
 
-  void output_inc_inst(std::ofstream & out, Instruction_inc * inc) {
+  void output_inc_inst(std::ostream & out, Instruction_inc * inc) {
     /**
      *  rdi++ => inc rdi
      * */
@@ -719,7 +720,7 @@ namespace L1{
     out << '\n';
   }
   
-  void output_dec_inst(std::ofstream & out, Instruction_dec * dec) {
+  void output_dec_inst(std::ostream & out, Instruction_dec * dec) {
     /**
      *  rdi-- => dec rdi
      * */
@@ -729,7 +730,7 @@ namespace L1{
     out << '\n';
   }
 
-  void output_cjump_inst(std::ofstream & out, Instruction_cjump * cjump) {
+  void output_cjump_inst(std::ostream & out, Instruction_cjump * cjump) {
     /**
      *  cjump rax <= rdi :yes 
      * ==>>
@@ -805,7 +806,7 @@ namespace L1{
 
 
 
-  void output_inst(std::ofstream & out, Function * function, Instruction * inst) {
+  void output_inst(std::ostream & out, Function * function, Instruction * inst) {
     switch(inst->type) {
       case InstType::inst_ret :
       {
@@ -893,7 +894,19 @@ namespace L1{
 
   
 
-  void output_function(std::ofstream & out, Function * function) {
+  /**
+   *  true if the rest of @function after position @idx is made of labels only
+   * */
+  bool only_labels_after(Function * function, int32_t idx) {
+    for (size_t i = idx + 1; i < function->instructions.size(); i++) {
+      if (function->instructions[i]->type != InstType::inst_label) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void output_function(std::ostream & out, Function * function, std::vector<StackMapEntry> & maps) {
     /**
      *  output function label
      * */
@@ -904,41 +917,72 @@ namespace L1{
      * */
     alloc_locals(out, function);
 
-    for (auto inst: function->instructions) {
+    FunctionStackMaps stackMaps(function);
+
+    for (int32_t i = 0; i < (int32_t) function->instructions.size(); i++) {
+      Instruction * inst = function->instructions[i];
       output_inst(out, function, inst);
-    }
 
+      if (!stackMaps.is_precise()) {
+        continue;
+      }
+
+      if (inst->type == InstType::inst_label && !only_labels_after(function, i)) {
+        /**
+         *  a user call may return here
+         *      labels at the very end share their address with the next function
+         * */
+        std::string & name = ((Instruction_label *) inst)->labelName;
+        maps.push_back({"_" + name.substr(1), stackMaps.frame_words(), stackMaps.live_in(i)});
 
-    
+      } else if (inst->type == InstType::inst_call
+        && ((Instruction_call *) inst)->isRuntimeCall
+        && ((Instruction_call_runtime *) inst)->callee == "allocate"
+      ) {
+        /**
+         *  the return address of allocate is where a collection starts its walk
+         * */
+        std::string label = ".Lgc_map_" + std::to_string(maps.size());
+        out << label << ":\n";
+        maps.push_back({label, stackMaps.frame_words(), stackMaps.live_out(i)});
+      }
+    }
   }
 
-  void generate_code(Program p){
+  void generate_code(Program & p, std::ostream & out){
 
-    /* 
-     * Open the output file.
-     */ 
-    std::ofstream outputFile;
-    outputFile.open("prog.S");
-   
     /* 
      * Generate target code
      */ 
-    //TODO
-    output_header(outputFile);
-    push_caller_save(outputFile);
+    output_header(out);
+    push_caller_save(out);
 
-    call_entryPoint(outputFile, p);
+    call_entryPoint(out, p);
 
 
-    pop_caller_save(outputFile);
-    output_ret(outputFile);
+    pop_caller_save(out);
+    output_ret(out);
 
-    empty_lines(outputFile, 2);
+    empty_lines(out, 2);
 
+    std::vector<StackMapEntry> maps;
     for (auto f: p.functions) {
-      output_function(outputFile, f);
-      empty_lines(outputFile, 2);
+      output_function(out, f, maps);
+      empty_lines(out, 2);
     }
+
+    output_stack_maps(out, maps);
+  }
+
+  void generate_code(Program p){
+
+    /* 
+     * Open the output file.
+     */ 
+    std::ofstream outputFile;
+    outputFile.open("prog.S");
+   
+    generate_code(p, outputFile);
   
     /* 
      * Close the output file.
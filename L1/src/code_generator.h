@@ -1,9 +1,11 @@
 #pragma once
 
+#include <ostream>
 #include <L1.h>
 
 namespace L1{
 
   void generate_code(Program p);
+  void generate_code(Program & p, std::ostream & out);
 
 }
@@ -1596,4 +1596,21 @@ namespace L1 {
     return p;
   }
 
+  Program parse_string (const std::string & source, const std::string & sourceName){
+
+    /* 
+     * Check the grammar for some possible issues.
+     */
+    pegtl::analyze< grammar >();
+
+    /*
+     * Parse.
+     */   
+    memory_input< > memInput(source, sourceName);
+    Program p;
+    parse< grammar, action >(memInput, p);
+
+    return p;
+  }
+
 }
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <string>
 #include <L1.h>
 
 namespace L1{
   Program parse_file (char *fileName);
+  Program parse_string (const std::string & source, const std::string & sourceName);
 }
@@ -0,0 +1,13 @@
+#include <pipeline.h>
+#include <parser.h>
+#include <code_generator.h>
+
+namespace L1{
+
+  void compile_source(const std::string & source, const std::string & sourceName, std::ostream & out){
+    auto p = L1::parse_string(source, sourceName);
+
+    L1::generate_code(p, out);
+  }
+
+}
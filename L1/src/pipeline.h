@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <ostream>
+
+namespace L1{
+
+  /*
+   * Compile the L1 program held in @source and write the x86_64 assembly to @out.
+   * Used by the single-process driver; @sourceName is only used in parse errors.
+   */
+  void compile_source(const std::string & source, const std::string & sourceName, std::ostream & out);
+
+}
@@ -0,0 +1,319 @@
+#include <stack_map.h>
+
+#define QUADSIZE 8
+#define REG_ARGS_NUM 6
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+namespace L1 {
+
+  FunctionStackMaps::FunctionStackMaps(Function * F) {
+    this->F = F;
+    this->precise = true;
+    this->frameWords = F->locals + MAX(F->arguments - REG_ARGS_NUM, 0);
+    this->words = (frameWords + 63) / 64;
+
+    calculate_GENKILL();
+    calculate_successors();
+    if (precise) {
+      calculate_INOUT();
+    }
+  }
+
+  bool FunctionStackMaps::is_precise() {
+    return precise;
+  }
+
+  int64_t FunctionStackMaps::frame_words() {
+    return frameWords;
+  }
+
+  int64_t FunctionStackMaps::get_slot(Item * it) {
+    switch (it->itemtype) {
+      case ItemType::item_registers:
+      {
+        if (((ItemRegister *) it)->rType == rsp) {
+          precise = false;
+        }
+        return -1;
+      }
+
+      case ItemType::item_memory:
+      {
+        ItemMemoryAccess * m = (ItemMemoryAccess *) it;
+        if (m->rType != rsp) {
+          return -1;
+        }
+        if (m->offset < 0 && m->offset % QUADSIZE == 0) {
+          /**
+           *  return address and arguments of a call being set up
+           * */
+          return -1;
+        }
+        if (m->offset % QUADSIZE != 0 || m->offset >= frameWords * QUADSIZE) {
+          precise = false;
+          return -1;
+        }
+        return m->offset / QUADSIZE;
+      }
+
+      case ItemType::item_cmp:
+      {
+        ItemCmp * cmp = (ItemCmp *) it;
+        get_slot(cmp->op1);
+        get_slot(cmp->op2);
+        return -1;
+      }
+
+      default:
+        return -1;
+    }
+  }
+
+  void FunctionStackMaps::use(int32_t idx, Item * it) {
+    int64_t slot = get_slot(it);
+    if (slot < 0) {
+      if (it->itemtype == ItemType::item_memory && ((ItemMemoryAccess *) it)->rType == rsp) {
+        /**
+         *  only the caller writes below its rsp
+         * */
+        precise = false;
+      }
+      return ;
+    }
+    GEN[idx][slot / 64] |= (uint64_t)1 << (slot % 64);
+  }
+
+  void FunctionStackMaps::define(int32_t idx, Item * it) {
+    int64_t slot = get_slot(it);
+    if (slot < 0) {
+      return ;
+    }
+    KILL[idx][slot / 64] |= (uint64_t)1 << (slot % 64);
+  }
+
+  void FunctionStackMaps::calculate_GENKILL() {
+    int32_t n = F->instructions.size();
+    GEN.assign(n, std::vector<uint64_t>(words, 0));
+    KILL.assign(n, std::vector<uint64_t>(words, 0));
+
+    for (int32_t i = 0; i < n; i++) {
+      Instruction * inst = F->instructions[i];
+      switch (inst->type) {
+        case InstType::inst_assign:
+        {
+          Instruction_assignment * assign = (Instruction_assignment *) inst;
+          use(i, assign->src);
+          define(i, assign->dst);
+          break;
+        }
+
+        case InstType::inst_aop:
+        {
+          /**
+           *  the destination is read as well
+           * */
+          Instruction_aop * aop = (Instruction_aop *) inst;
+          use(i, aop->op1);
+          use(i, aop->op2);
+          break;
+        }
+
+        case InstType::inst_sop:
+        {
+          Instruction_sop * sop = (Instruction_sop *) inst;
+          use(i, sop->target);
+          use(i, sop->offset);
+          break;
+        }
+
+        case InstType::inst_lea:
+        {
+          Instruction_lea * lea = (Instruction_lea *) inst;
+          use(i, lea->dst);
+          use(i, lea->addr);
+          use(i, lea->multr);
+          break;
+        }
+
+        case InstType::inst_inc:
+          use(i, ((Instruction_inc *) inst)->op);
+          break;
+
+        case InstType::inst_dec:
+          use(i, ((Instruction_dec *) inst)->op);
+          break;
+
+        case InstType::inst_cjump:
+          use(i, ((Instruction_cjump *) inst)->condition);
+          break;
+
+        case InstType::inst_call:
+        {
+          Instruction_call * call = (Instruction_call *) inst;
+          if (!call->isRuntimeCall) {
+            use(i, ((Instruction_call_user *) inst)->callee);
+          }
+          break;
+        }
+
+        default:
+          break;
+      }
+    }
+  }
+
+  void FunctionStackMaps::calculate_successors() {
+    int32_t n = F->instructions.size();
+    succs.assign(n, std::vector<int32_t>());
+
+    /**
+     *  a user call returns to one of the labels the function stores
+     * */
+    std::vector<int32_t> returnLabels;
+    for (int32_t i = 0; i < n; i++) {
+      Instruction * inst = F->instructions[i];
+      if (inst->type == InstType::inst_label) {
+        label2idx[((Instruction_label *) inst)->labelName] = i;
+      }
+    }
+    for (int32_t i = 0; i < n; i++) {
+      Instruction * inst = F->instructions[i];
+      if (inst->type == InstType::inst_assign) {
+        Item * src = ((Instruction_assignment *) inst)->src;
+        if (src->itemtype == ItemType::item_labels) {
+          auto it = label2idx.find(((ItemLabel *) src)->labelName);
+          if (it != label2idx.end()) {
+            returnLabels.push_back(it->second);
+          }
+        }
+      }
+    }
+
+    for (int32_t i = 0; i < n && precise; i++) {
+      Instruction * inst = F->instructions[i];
+      bool fallThrough = true;
+
+      switch (inst->type) {
+        case InstType::inst_ret:
+          fallThrough = false;
+          break;
+
+        case InstType::inst_goto:
+        case InstType::inst_cjump:
+        {
+          Item * target = inst->type == InstType::inst_goto
+            ? ((Instruction_goto *) inst)->gotoLabel
+            : ((Instruction_cjump *) inst)->dst;
+          auto it = label2idx.find(((ItemLabel *) target)->labelName);
+          if (it == label2idx.end()) {
+            precise = false;
+            break;
+          }
+          succs[i].push_back(it->second);
+          fallThrough = inst->type == InstType::inst_cjump;
+          break;
+        }
+
+        case InstType::inst_call:
+        {
+          Instruction_call * call = (Instruction_call *) inst;
+          if (call->isRuntimeCall) {
+            fallThrough = ((Instruction_call_runtime *) call)->callee != "tensor-error";
+          } else {
+            succs[i].insert(succs[i].end(), returnLabels.begin(), returnLabels.end());
+          }
+          break;
+        }
+
+        default:
+          break;
+      }
+
+      if (fallThrough && i + 1 < n) {
+        succs[i].push_back(i + 1);
+      }
+    }
+  }
+
+  void FunctionStackMaps::calculate_INOUT() {
+    int32_t n = F->instructions.size();
+    IN.assign(n, std::vector<uint64_t>(words, 0));
+    OUT.assign(n, std::vector<uint64_t>(words, 0));
+
+    /**
+     *  IN[i] = GEN[i] U (OUT[i] - KILL[i]), OUT[i] = U IN[succ]
+     *      sweep backward until nothing changes
+     * */
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (int32_t i = n - 1; i >= 0; i--) {
+        for (int64_t w = 0; w < words; w++) {
+          uint64_t out = 0;
+          for (auto s : succs[i]) {
+            out |= IN[s][w];
+          }
+          uint64_t in = GEN[i][w] | (out & ~KILL[i][w]);
+          if (out != OUT[i][w] || in != IN[i][w]) {
+            OUT[i][w] = out;
+            IN[i][w] = in;
+            changed = true;
+          }
+        }
+      }
+    }
+  }
+
+  std::vector<int64_t> FunctionStackMaps::to_slots(std::vector<uint64_t> & bits) {
+    std::vector<int64_t> slots;
+    for (int64_t slot = 0; slot < frameWords; slot++) {
+      if (bits[slot / 64] & ((uint64_t)1 << (slot % 64))) {
+        slots.push_back(slot);
+      }
+    }
+    return slots;
+  }
+
+  std::vector<int64_t> FunctionStackMaps::live_in(int32_t idx) {
+    return to_slots(IN[idx]);
+  }
+
+  std::vector<int64_t> FunctionStackMaps::live_out(int32_t idx) {
+    return to_slots(OUT[idx]);
+  }
+
+  void output_stack_maps(std::ostream & out, std::vector<StackMapEntry> & entries) {
+    /**
+     *  gc_stack_map_num:   number of entries
+     *  gc_stack_maps:      (return address, frame words, first slot, slot number) per entry
+     *  gc_stack_map_slots: the slots of every entry, one after the other
+     * */
+    out << ".section .rodata\n";
+    out << "  .align 8\n";
+    out << "  .globl gc_stack_map_num\n";
+    out << "gc_stack_map_num:\n";
+    out << "  .quad " << entries.size() << '\n';
+
+    out << "  .globl gc_stack_maps\n";
+    out << "gc_stack_maps:\n";
+    int64_t firstSlot = 0;
+    for (auto & e : entries) {
+      out << "  .quad " << e.label << ", " << e.frameWords << ", " << firstSlot << ", " << e.slots.size() << '\n';
+      firstSlot += e.slots.size();
+    }
+
+    out << "  .globl gc_stack_map_slots\n";
+    out << "gc_stack_map_slots:\n";
+    for (auto & e : entries) {
+      if (e.slots.empty()) {
+        continue;
+      }
+      out << "  .quad ";
+      for (size_t i = 0; i < e.slots.size(); i++) {
+        out << (i > 0 ? ", " : "") << e.slots[i];
+      }
+      out << '\n';
+    }
+  }
+
+}
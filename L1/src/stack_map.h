@@ -0,0 +1,80 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <L1.h>
+
+namespace L1 {
+
+  /**
+   *  Live stack slots at one return address of the program
+   *      the runtime looks the return address up while walking the stack
+   *      and only scans @slots of the frame above it
+   * */
+  struct StackMapEntry {
+    std::string label;              /* assembly label of the return address */
+    int64_t frameWords;             /* locals and stack arguments of the frame */
+    std::vector<int64_t> slots;     /* word offsets from the rsp of the frame */
+  };
+
+  /**
+   *  Liveness of the stack slots of a function
+   *      slot i is the word `mem rsp 8*i`: the locals come first, then the
+   *      stack arguments, the return address of the frame follows them
+   * */
+  class FunctionStackMaps {
+  public:
+    FunctionStackMaps(Function * F);
+
+    /**
+     *  false if F uses rsp other than as the base of a frame slot
+     *      (e.g. takes its address or moves it), then its frames are
+     *      left to the conservative scan and no entry is emitted
+     * */
+    bool is_precise();
+
+    int64_t frame_words();
+
+    /**
+     *  slots live before/after the instruction at position @idx of F
+     * */
+    std::vector<int64_t> live_in(int32_t idx);
+    std::vector<int64_t> live_out(int32_t idx);
+
+  private:
+    Function * F;
+    bool precise;
+    int64_t frameWords;
+    int64_t words;
+
+    std::vector<std::vector<uint64_t>> GEN;
+    std::vector<std::vector<uint64_t>> KILL;
+    std::vector<std::vector<uint64_t>> IN;
+    std::vector<std::vector<uint64_t>> OUT;
+    std::vector<std::vector<int32_t>> succs;
+
+    std::unordered_map<std::string, int32_t> label2idx;
+
+    /**
+     *  slot of @it, -1 if @it does not access the frame
+     *      makes F imprecise if @it uses rsp in any other way
+     * */
+    int64_t get_slot(Item * it);
+    void use(int32_t idx, Item * it);
+    void define(int32_t idx, Item * it);
+
+    void calculate_GENKILL();
+    void calculate_successors();
+    void calculate_INOUT();
+    std::vector<int64_t> to_slots(std::vector<uint64_t> & bits);
+  };
+
+  /**
+   *  Output the stack map table of the program into the read-only data
+   *      @entries must be in code order, so the table is sorted by address
+   * */
+  void output_stack_maps(std::ostream & out, std::vector<StackMapEntry> & entries);
+
+}
@@ -251,8 +251,11 @@ namespace L2 {
     }
 
     ItemLabel * ItemLabel::copy(){
-
-        return new ItemLabel(this->labelName);
+        /**
+         *  labels are shared through labelName2ptr like variables,
+         *      jumps find their target label instruction by pointer
+         * */
+        return this;
     }
 
     ItemMemoryAccess * ItemMemoryAccess::copy(){
@@ -19,12 +19,13 @@
 #include <code_generator.h>
 #include <spiller.h>
 #include <register_allocation.h>
+#include <linear_scan.h>
 #include <utils.h>
 
 using namespace std;
 
 void print_help (char *progName){
-    std::cerr << "Usage: " << progName << " [-v] [-g 0|1] [-O 0|1|2] [-s] [-l] [-i] SOURCE" << std::endl;
+    std::cerr << "Usage: " << progName << " [-v] [-g 0|1] [-O 0|1|2] [-L INSTRUCTIONS] [-s] [-l] [-i] SOURCE" << std::endl;
     return ;
 }
 
@@ -37,6 +38,8 @@ int main(
     auto interference_only = false;
     auto liveness_only = false;
     int32_t optLevel = 3;
+    int64_t linearScanThreshold = -1;
+    auto linearScanThresholdSet = false;
 
     // std::cout << "begin!\n";
     /* 
@@ -48,7 +51,7 @@ int main(
         return 1;
     }
     int32_t opt;
-    while ((opt = getopt(argc, argv, "vg:O:sli")) != -1) {
+    while ((opt = getopt(argc, argv, "vg:O:L:sli")) != -1) {
         switch (opt){
 
             case 'l':
@@ -67,6 +70,11 @@ int main(
                 optLevel = strtoul(optarg, NULL, 0);
                 break ;
 
+            case 'L':
+                linearScanThreshold = strtol(optarg, NULL, 0);
+                linearScanThresholdSet = true;
+                break ;
+
             case 'g':
                 enable_code_generator = (strtoul(optarg, NULL, 0) == 0) ? false : true ;
                 break ;
@@ -147,7 +155,19 @@ int main(
      */
     if (enable_code_generator){
         // TODO
-        L2::run_register_allocation(p);
+        /**
+         *  -O 2 and above keep spilled variables in registers inside basic blocks
+         * */
+        L2::SpillMode spillMode = (optLevel >= 2) ? L2::spill_split_blocks : L2::spill_everywhere;
+
+        /**
+         *  linear scan: -O 0 for every function, -O 1 for large ones,
+         *      -L overrides the instruction threshold
+         * */
+        if (!linearScanThresholdSet) {
+            linearScanThreshold = (optLevel == 0) ? 0 : (optLevel == 1) ? L2::LINEAR_SCAN_THRESHOLD : -1;
+        }
+        L2::run_register_allocation(p, spillMode, linearScanThreshold);
         L2::generate_code(p);
         return 0;
     }
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <algorithm>
 
 #include "analysis.h"
 
@@ -74,39 +75,9 @@ namespace L2
         }
     }
 
-    bool calc_live_OUT2IN(
-        Instruction *inst,
-        LiveSet &GEN,
-        LiveSet &KILL,
-        LiveSet &IN,
-        LiveSet &OUT)
-    {
-        std::set<Item *> tempIN;
-        /**
-             *  p = &x;
-             *  IN[i] = GEN[i] U (OUT[i] – KILL[i])
-             * */
-        std::set<Item *> outMinusKill;
-        set_diff(
-            OUT[inst],   /* srcA */
-            KILL[inst],  /* srcB */
-            outMinusKill /* target */
-        );
-
-        set_union(
-            outMinusKill, /* srcA */
-            GEN[inst],    /* srcB */
-            tempIN        /* target */
-        );
-
-        bool diff = tempIN != IN[inst];
-        IN[inst] = tempIN;
-        return diff;
-    }
-
     FunctionLivenessAnalyzer::FunctionLivenessAnalyzer(Function * F){
         this->F = F;
-        
+        this->setsBuilt = false;
     }
 
     void FunctionLivenessAnalyzer::calculate_GENKILL() {
@@ -184,120 +155,180 @@ OUT[return] = {}
 
      * */
 
+    void FunctionLivenessAnalyzer::number_items() {
+        int32_t instNum = this->F->instructions.size();
+
+        for (Instruction * inst : this->F->instructions) {
+            for (Item * item : this->live_visitor.GEN[inst]) {
+                if (!IN_MAP(this->item2idx, item)) {
+                    this->item2idx[item] = this->items.size();
+                    this->items.push_back(item);
+                }
+            }
+            for (Item * item : this->live_visitor.KILL[inst]) {
+                if (!IN_MAP(this->item2idx, item)) {
+                    this->item2idx[item] = this->items.size();
+                    this->items.push_back(item);
+                }
+            }
+        }
+
+        int32_t itemNum = this->items.size();
+        this->instGEN.assign(instNum, BitVector(itemNum));
+        this->instKILL.assign(instNum, BitVector(itemNum));
+        this->instIN.assign(instNum, BitVector(itemNum));
+        this->instOUT.assign(instNum, BitVector(itemNum));
+
+        for (int32_t i = 0; i < instNum; i++) {
+            Instruction * inst = this->F->instructions[i];
+            this->inst2slot[inst] = i;
+
+            for (Item * item : this->live_visitor.GEN[inst]) {
+                this->instGEN[i].set(this->item2idx[item]);
+            }
+            for (Item * item : this->live_visitor.KILL[inst]) {
+                this->instKILL[i].set(this->item2idx[item]);
+            }
+        }
+    }
+
+    void FunctionLivenessAnalyzer::build_blocks() {
+        int32_t instNum = this->F->instructions.size();
+        int32_t itemNum = this->items.size();
+
+        std::unordered_map<Instruction *, int32_t> inst2idx;
+        for (int32_t i = 0; i < instNum; i++) {
+            inst2idx[this->F->instructions[i]] = i;
+        }
+
+        /**
+         *  a block ends when control does not simply fall into the next instruction
+         *      or when the next instruction is a label (a possible jump target)
+         * */
+        std::vector<int32_t> inst2block(instNum);
+        int32_t first = 0;
+        for (int32_t i = 0; i < instNum; i++) {
+            std::vector<Instruction *> & succs = this->succVisitor.successor[this->F->instructions[i]];
+            bool isLast = i + 1 == instNum;
+            bool fallsThrough = !isLast && succs.size() == 1 && succs[0] == this->F->instructions[i + 1];
+            bool nextIsLabel = !isLast && this->F->instructions[i + 1]->type == InstType::inst_label;
+
+            inst2block[i] = this->blocks.size();
+            if (isLast || !fallsThrough || nextIsLabel) {
+                LiveBlock block;
+                block.first = first;
+                block.last = i;
+                this->blocks.push_back(block);
+                first = i + 1;
+            }
+        }
+
+        for (int32_t b = 0; b < this->blocks.size(); b++) {
+            LiveBlock & block = this->blocks[b];
+            for (Instruction * succ : this->succVisitor.successor[this->F->instructions[block.last]]) {
+                /**
+                 *  jumps to labels that are not defined in F have no successor
+                 * */
+                if (succ == NULL) continue;
+
+                int32_t s = inst2block[inst2idx[succ]];
+                block.succs.push_back(s);
+                this->blocks[s].preds.push_back(b);
+            }
+
+            /**
+             *  GEN[b] = GEN[i] U (GEN[b] - KILL[i]) walking the block backward
+             * */
+            block.GEN.resize(itemNum);
+            block.KILL.resize(itemNum);
+            block.IN.resize(itemNum);
+            block.OUT.resize(itemNum);
+            for (int32_t i = block.last; i >= block.first; i--) {
+                block.GEN.assign_transfer(this->instGEN[i], block.GEN, this->instKILL[i]);
+                block.KILL.union_with(this->instKILL[i]);
+            }
+        }
+    }
+
     void FunctionLivenessAnalyzer::calculate_INOUT() {
         /**
          *  Find successors for each instruction
          * */
         this->succVisitor.find_successors(this->F);
 
-        bool changed;
+        this->number_items();
+        this->build_blocks();
 
-        do {
-            changed = false;
-            for (auto inst_it= F->instructions.rbegin(); inst_it != F->instructions.rend(); inst_it++ ){
-                Instruction * inst = *inst_it;
-                
-                // std::cerr <<  "successor size "<< this->succVisitor.successor[inst].size() << '\n';
-                this->OUT[inst].clear();
-                for (Instruction * succ : this->succVisitor.successor[inst]){
-                    this->OUT[inst].insert(
-                        this->IN[succ].begin(),
-                        this->IN[succ].end()
-                    );
-                }
-                
-                // output_INOUT();
-
-                bool in_changed = calc_live_OUT2IN(
-                                    inst,
-                                    this->live_visitor.GEN,
-                                    this->live_visitor.KILL,
-                                    this->IN,
-                                    this->OUT
-                                );
-                
-                if (!changed) changed = in_changed;
+        /**
+         *  Worklist over blocks, seeded in reverse order since liveness flows backward.
+         *      IN sets only grow, so OUT can be accumulated without being cleared
+         * */
+        std::vector<int32_t> worklist;
+        std::vector<bool> inWorklist(this->blocks.size(), true);
+        for (int32_t b = 0; b < this->blocks.size(); b++) {
+            worklist.push_back(b);
+        }
+
+        while (!worklist.empty()) {
+            int32_t b = worklist.back();
+            worklist.pop_back();
+            inWorklist[b] = false;
 
-                // output_INOUT();
+            LiveBlock & block = this->blocks[b];
+            for (int32_t s : block.succs) {
+                block.OUT.union_with(this->blocks[s].IN);
             }
 
-            // for (Instruction * inst : F->instructions){
-            //     // Instruction * inst = *inst_it;
-                
-            //     bool in_changed = calc_live_OUT2IN(
-            //                         inst,
-            //                         this->live_visitor.GEN,
-            //                         this->live_visitor.KILL,
-            //                         this->IN,
-            //                         this->OUT
-            //                     );
-
-            //     std::set<Item *> tempOut;            
-            //     /**
-            //      *  Calculate OUT of current instruction from IN of successors
-            //      * */
-            //     for (Instruction * succ : this->succVisitor.successor[inst]){
-            //         this->OUT[inst].insert(
-            //             this->IN[inst].begin(),
-            //             this->IN[inst].end()
-            //         );
-            //     }
-            //     bool out_changed = this->OUT[inst] != tempOut;
+            bool in_changed = block.IN.assign_transfer(block.GEN, block.OUT, block.KILL);
+            if (!in_changed) continue;
 
-                
-                
-            //     changed = changed || in_changed || out_changed;
+            for (int32_t pred : block.preds) {
+                if (!inWorklist[pred]) {
+                    inWorklist[pred] = true;
+                    worklist.push_back(pred);
+                }
+            }
+        }
+
+        /**
+         *  Propagate the block results to every instruction
+         *      IN[i] = GEN[i] U (OUT[i] - KILL[i])
+         * */
+        for (LiveBlock & block : this->blocks) {
+            for (int32_t i = block.last; i >= block.first; i--) {
+                this->instOUT[i] = (i == block.last) ? block.OUT : this->instIN[i + 1];
+                this->instIN[i].assign_transfer(this->instGEN[i], this->instOUT[i], this->instKILL[i]);
+            }
+        }
+    }
 
-            // }
+    void FunctionLivenessAnalyzer::output_bits(BitVector & bits) {
+        std::vector<int32_t> indices;
+        bits.to_indices(indices);
 
-        } while(changed);
-        
+        std::cout << '(';
+        for (int32_t k = 0; k < indices.size(); k++) {
+            if (k > 0) std::cout << ' ' ;
+
+            std::cout << this->items[indices[k]]->to_string();
+        }
+        std::cout << ')' << '\n';
     }
 
     void FunctionLivenessAnalyzer::output_INOUT() {
         std::cout << '(' << '\n'; 
         std::cout << '(' << "in" << '\n';
         
-        for (Instruction *inst : this->F->instructions){
-            // std::cerr << "gen size = " << this->live_visitor.GEN[inst].size() << '\n';
-            std::cout << '(';
-            // for(Item * item : this->IN[inst]){
-            //     // std::cerr << item->to_string();
-            //     item->accept(this->item_output_visitor);
-            //     std::cerr << ' ' ;
-            // }   
-
-            for (auto it = this->IN[inst].begin(); it != this->IN[inst].end(); it++){
-                if (it != this->IN[inst].begin()) std::cout << ' ' ;
-
-                std::cout << (*it)->to_string();
-                // (*it)->accept(this->item_output_visitor);
-            }
-            std::cout << ')' << '\n';
+        for (BitVector & bits : this->instIN){
+            this->output_bits(bits);
         } 
 
-        
         std::cout << ')' << '\n';
         std::cout << '\n';
         std::cout << '(' << "out" << '\n';
         
-        for (Instruction *inst : this->F->instructions){
-            // std::cerr << "gen size = " << this->live_visitor.GEN[inst].size() << '\n';
-            std::cout << '(';
-
-            // for(Item * item : this->OUT[inst]){
-            //     // std::cerr << item->to_string();
-            //     item->accept(this->item_output_visitor);
-            //     std::cerr << ' ' ;
-            // }   
-
-            for (auto it = this->OUT[inst].begin(); it != this->OUT[inst].end(); it++){
-                if (it != this->OUT[inst].begin()) std::cout << ' ' ;
-
-                std::cout << (*it)->to_string();
-                // (*it)->accept(this->item_output_visitor);
-            }
-            std::cout << ')' << '\n';
+        for (BitVector & bits : this->instOUT){
+            this->output_bits(bits);
         } 
 
         std::cout << ')' << '\n';
@@ -305,6 +336,30 @@ OUT[return] = {}
         std::cout << ')' << '\n';
     }
 
+    void FunctionLivenessAnalyzer::build_sets() {
+        if (this->setsBuilt) return;
+
+        for (int32_t i = 0; i < this->F->instructions.size(); i++) {
+            Instruction * inst = this->F->instructions[i];
+            std::set<Item *> & inSet = this->IN[inst];
+            std::set<Item *> & outSet = this->OUT[inst];
+            std::vector<int32_t> indices;
+
+            this->instIN[i].to_indices(indices);
+            for (int32_t idx : indices) {
+                inSet.insert(this->items[idx]);
+            }
+
+            indices.clear();
+            this->instOUT[i].to_indices(indices);
+            for (int32_t idx : indices) {
+                outSet.insert(this->items[idx]);
+            }
+        }
+
+        this->setsBuilt = true;
+    }
+
     LiveSet & FunctionLivenessAnalyzer::get_live_KILL()
     {
         return this->live_visitor.KILL;
@@ -312,14 +367,281 @@ OUT[return] = {}
 
     LiveSet & FunctionLivenessAnalyzer::get_live_IN() 
     {
+        this->build_sets();
         return this->IN;
     }
 
     LiveSet & FunctionLivenessAnalyzer::get_live_OUT()
     {
+        this->build_sets();
         return this->OUT;
     }
 
+    std::vector<Item *> & FunctionLivenessAnalyzer::get_items()
+    {
+        return this->items;
+    }
+
+    std::vector<BitVector> & FunctionLivenessAnalyzer::get_GEN_bits()
+    {
+        return this->instGEN;
+    }
+
+    std::vector<BitVector> & FunctionLivenessAnalyzer::get_KILL_bits()
+    {
+        return this->instKILL;
+    }
+
+    std::vector<BitVector> & FunctionLivenessAnalyzer::get_IN_bits()
+    {
+        return this->instIN;
+    }
+
+    std::vector<BitVector> & FunctionLivenessAnalyzer::get_OUT_bits()
+    {
+        return this->instOUT;
+    }
+
+    std::vector<int32_t> & FunctionLivenessAnalyzer::get_loop_depths()
+    {
+        if (this->loopDepths.size() != this->instGEN.size()) {
+            this->calculate_loop_depths();
+        }
+        return this->loopDepths;
+    }
+
+    int32_t FunctionLivenessAnalyzer::get_slot(Instruction * inst)
+    {
+        auto it = this->inst2slot.find(inst);
+        if (it == this->inst2slot.end()) {
+            return -1;
+        }
+        return it->second;
+    }
+
+    BitVector & FunctionLivenessAnalyzer::get_dead_items()
+    {
+        return this->deadItems;
+    }
+
+    void FunctionLivenessAnalyzer::update_after_spill(
+        Item * spilled,
+        std::vector<int32_t> & touched,
+        std::vector<int32_t> & changedSlots
+    ) {
+        std::vector<Instruction *> & insts = this->F->instructions;
+        std::vector<int32_t> & depths = this->get_loop_depths();
+
+        /**
+         *  GEN/KILL of the touched instructions, the temporaries get new indices
+         * */
+        LivenessVisitor visitor;
+        int32_t firstNew = this->items.size();
+        for (int32_t p : touched) {
+            insts[p]->accept(visitor);
+
+            for (Item * item : visitor.GEN[insts[p]]) {
+                if (!IN_MAP(this->item2idx, item)) {
+                    this->item2idx[item] = this->items.size();
+                    this->items.push_back(item);
+                }
+            }
+            for (Item * item : visitor.KILL[insts[p]]) {
+                if (!IN_MAP(this->item2idx, item)) {
+                    this->item2idx[item] = this->items.size();
+                    this->items.push_back(item);
+                }
+            }
+        }
+        int32_t itemNum = this->items.size();
+
+        this->deadItems.grow(itemNum);
+        if (IN_MAP(this->item2idx, spilled)) {
+            this->deadItems.set(this->item2idx[spilled]);
+        }
+
+        /**
+         *  live range [first, last] of every temporary, in positions
+         * */
+        std::vector<BitVector> touchedGEN(touched.size(), BitVector(itemNum));
+        std::vector<BitVector> touchedKILL(touched.size(), BitVector(itemNum));
+        std::vector<int32_t> first(itemNum - firstNew, -1);
+        std::vector<int32_t> last(itemNum - firstNew, -1);
+        std::vector<int32_t> indices;
+
+        for (int32_t k = 0; k < touched.size(); k++) {
+            Instruction * inst = insts[touched[k]];
+            for (Item * item : visitor.GEN[inst]) {
+                touchedGEN[k].set(this->item2idx[item]);
+            }
+            for (Item * item : visitor.KILL[inst]) {
+                touchedKILL[k].set(this->item2idx[item]);
+            }
+
+            indices.clear();
+            touchedGEN[k].to_indices(indices);
+            touchedKILL[k].to_indices(indices);
+            for (int32_t v : indices) {
+                if (v < firstNew) continue;
+                if (first[v - firstNew] < 0) first[v - firstNew] = touched[k];
+                last[v - firstNew] = touched[k];
+            }
+        }
+
+        /**
+         *  merge the overlapping live ranges, each group keeps its temporaries
+         * */
+        std::vector<int32_t> order;
+        for (int32_t t = 0; t < itemNum - firstNew; t++) {
+            if (first[t] >= 0) order.push_back(t);
+        }
+        std::sort(order.begin(), order.end(), [&](int32_t a, int32_t b) {
+            return first[a] < first[b];
+        });
+
+        struct Pending {
+            Instruction * inst;
+            int32_t slot;
+            int32_t baseSlot;
+            BitVector GEN;
+            BitVector KILL;
+            BitVector IN;
+            BitVector OUT;
+        };
+        std::vector<Pending> pending;
+
+        int32_t k = 0;
+        for (int32_t g = 0; g < order.size(); ) {
+            int32_t groupFirst = first[order[g]];
+            int32_t groupLast = last[order[g]];
+            int32_t groupEnd = g + 1;
+            while (groupEnd < order.size() && first[order[groupEnd]] <= groupLast) {
+                groupLast = MAX(groupLast, last[order[groupEnd]]);
+                groupEnd++;
+            }
+
+            for (int32_t p = groupFirst; p <= groupLast; p++) {
+                while (k < touched.size() && touched[k] < p) k++;
+                bool isTouched = k < touched.size() && touched[k] == p;
+
+                Pending cur;
+                cur.inst = insts[p];
+                cur.slot = this->get_slot(cur.inst);
+
+                /**
+                 *  an inserted instruction sees what is live before the next analyzed one
+                 * */
+                cur.baseSlot = cur.slot;
+                for (int32_t q = p + 1; cur.baseSlot < 0 && q < insts.size(); q++) {
+                    cur.baseSlot = this->get_slot(insts[q]);
+                }
+
+                if (cur.baseSlot >= 0) {
+                    cur.IN = this->instIN[cur.baseSlot];
+                    cur.OUT = (cur.slot >= 0) ? this->instOUT[cur.slot] : this->instIN[cur.baseSlot];
+                }
+                cur.IN.grow(itemNum);
+                cur.OUT.grow(itemNum);
+                cur.IN.subtract(this->deadItems);
+                cur.OUT.subtract(this->deadItems);
+
+                if (isTouched) {
+                    cur.GEN = touchedGEN[k];
+                    cur.KILL = touchedKILL[k];
+                } else if (cur.slot >= 0) {
+                    cur.GEN = this->instGEN[cur.slot];
+                    cur.KILL = this->instKILL[cur.slot];
+                }
+                cur.GEN.grow(itemNum);
+                cur.KILL.grow(itemNum);
+
+                for (int32_t m = g; m < groupEnd; m++) {
+                    int32_t t = order[m];
+                    if (p < first[t] || p > last[t]) continue;
+
+                    if (p > first[t] || cur.GEN.test(t + firstNew)) cur.IN.set(t + firstNew);
+                    if (p < last[t]) cur.OUT.set(t + firstNew);
+                }
+
+                pending.push_back(cur);
+            }
+
+            g = groupEnd;
+        }
+
+        for (Pending & cur : pending) {
+            int32_t slot = cur.slot;
+            if (slot < 0) {
+                slot = this->instGEN.size();
+                this->inst2slot[cur.inst] = slot;
+
+                this->instGEN.push_back(BitVector());
+                this->instKILL.push_back(BitVector());
+                this->instIN.push_back(BitVector());
+                this->instOUT.push_back(BitVector());
+                depths.push_back((cur.baseSlot >= 0) ? depths[cur.baseSlot] : 0);
+            }
+
+            this->instGEN[slot] = cur.GEN;
+            this->instKILL[slot] = cur.KILL;
+            this->instIN[slot] = cur.IN;
+            this->instOUT[slot] = cur.OUT;
+            changedSlots.push_back(slot);
+        }
+    }
+
+    void FunctionLivenessAnalyzer::calculate_loop_depths() {
+        int32_t blockNum = this->blocks.size();
+        std::vector<int32_t> blockDepth(blockNum, 0);
+
+        /**
+         *  tails[h] are the blocks jumping back to the header h
+         * */
+        std::vector<std::vector<int32_t>> tails(blockNum);
+        for (int32_t b = 0; b < blockNum; b++) {
+            for (int32_t s : this->blocks[b].succs) {
+                if (s <= b) tails[s].push_back(b);
+            }
+        }
+
+        /**
+         *  the loop of h is h plus every block reaching a tail without going through h
+         * */
+        std::vector<int32_t> inLoop(blockNum, -1);
+        std::vector<int32_t> worklist;
+        for (int32_t h = 0; h < blockNum; h++) {
+            if (tails[h].empty()) continue;
+
+            inLoop[h] = h;
+            blockDepth[h]++;
+            for (int32_t t : tails[h]) {
+                if (inLoop[t] == h) continue;
+                inLoop[t] = h;
+                blockDepth[t]++;
+                worklist.push_back(t);
+            }
+
+            while (!worklist.empty()) {
+                int32_t b = worklist.back();
+                worklist.pop_back();
+
+                for (int32_t pred : this->blocks[b].preds) {
+                    if (inLoop[pred] == h) continue;
+                    inLoop[pred] = h;
+                    blockDepth[pred]++;
+                    worklist.push_back(pred);
+                }
+            }
+        }
+
+        this->loopDepths.assign(this->F->instructions.size(), 0);
+        for (int32_t b = 0; b < blockNum; b++) {
+            for (int32_t i = this->blocks[b].first; i <= this->blocks[b].last; i++) {
+                this->loopDepths[i] = blockDepth[b];
+            }
+        }
+    }
+
 
     void LivenessVisitor::visit(Instruction_ret *ret) 
     {
@@ -709,139 +1031,193 @@ OUT[return] = {}
     }
 
     InterferenceGraph::InterferenceGraph() {
-        this->nodes = std::set<Item *>();
-        this->edges =  std::map<Item *, std::set<Item *>>();
     }
 
-    InterferenceGraph::InterferenceGraph(
-        std::set<Item *> & nodes,
-        std::map<Item *, std::set<Item *>> & edges
-    ) {
+    InterferenceGraph::InterferenceGraph(std::vector<Item *> & nodes) {
         this->nodes = nodes;
-        this->edges = edges;
+        for (int32_t i = 0; i < nodes.size(); i++) {
+            this->node2idx[nodes[i]] = i;
+        }
+
+        this->adjMatrix.assign(nodes.size(), BitVector(nodes.size()));
+        this->adjList.assign(nodes.size(), std::vector<int32_t>());
     }
 
-    bool InterferenceGraph::add_edge(Item *v1, Item *v2) {
-        this->nodes.insert(v1);
-        this->nodes.insert(v2);
+    int32_t InterferenceGraph::node_num() {
+        return this->nodes.size();
+    }
 
-        this->edges[v1].insert(v2);
-        this->edges[v2].insert(v1);
+    Item * InterferenceGraph::get_node(int32_t idx) {
+        return this->nodes[idx];
+    }
 
-        return true;
+    int32_t InterferenceGraph::get_index(Item * node) {
+        auto it = this->node2idx.find(node);
+        if (it == this->node2idx.end()) {
+            return -1;
+        }
+        return it->second;
     }
 
-    bool InterferenceGraph::remove_node(Item * toRemove) {
-        if (!IN_SET(this->nodes, toRemove)) {
-            std::cerr << "cannot find node " << toRemove->to_string() << '\n';
+    bool InterferenceGraph::add_edge(Item *v1, Item *v2) {
+        int32_t idx1 = this->get_index(v1);
+        int32_t idx2 = this->get_index(v2);
+        if (idx1 < 0 || idx2 < 0) {
+            std::cerr << "cannot find node " << ((idx1 < 0) ? v1 : v2)->to_string() << '\n';
             return false;
         }
 
-    
-        /** 
-         *  toRemove -- v
-         *  delete (v, toRemove) 
-         * */
-        for (Item * v : this->edges[toRemove]) {
-            this->edges[v].erase(toRemove);
+        this->add_edge(idx1, idx2);
+
+        return true;
+    }
+
+    bool InterferenceGraph::add_edge(int32_t v1, int32_t v2) {
+        if (v1 == v2 || this->has_edge(v1, v2)) {
+            return false;
         }
 
         /**
-         *  Delete (toRemove, v)
+         *  rows of nodes added after the graph was built grow on demand
          * */
-        this->edges.erase(toRemove);
+        this->adjMatrix[v1].grow(this->node_num());
+        this->adjMatrix[v2].grow(this->node_num());
 
-        this->nodes.erase(toRemove);
+        this->adjMatrix[v1].set(v2);
+        this->adjMatrix[v2].set(v1);
+        this->adjList[v1].push_back(v2);
+        this->adjList[v2].push_back(v1);
 
         return true;
     }
-    
-    void InterferenceGraph::get_nodes_stats(std::map<int32_t, std::set<Item * >> & edgeCnt2nodes) {
-        for (Item * n : this->nodes) {
-            edgeCnt2nodes[this->edges[n].size()].insert(n);
+
+    void InterferenceGraph::connect(int32_t v, BitVector & others) {
+        this->adjMatrix[v].union_with(others);
+    }
+
+    void InterferenceGraph::finalize() {
+        for (int32_t v = 0; v < this->nodes.size(); v++) {
+            this->adjMatrix[v].reset(v);
+
+            this->adjList[v].clear();
+            this->adjMatrix[v].to_indices(this->adjList[v]);
         }
     }
-    
-    std::set<Item *> & InterferenceGraph::get_neighbors(Item * node) {
-        if (!IN_MAP(this->edges, node)){
 
-            std::cerr << "cannot find node " << node->to_string() << '\n';
+    int32_t InterferenceGraph::add_node(Item * node) {
+        int32_t idx = this->nodes.size();
+
+        this->nodes.push_back(node);
+        this->node2idx[node] = idx;
+        this->adjMatrix.push_back(BitVector(idx + 1));
+        this->adjList.push_back(std::vector<int32_t>());
+
+        return idx;
+    }
+
+    void InterferenceGraph::isolate(int32_t v) {
+        for (int32_t n : this->adjList[v]) {
+            this->adjMatrix[n].reset(v);
+
+            std::vector<int32_t> & nAdj = this->adjList[n];
+            for (int32_t j = 0; j < nAdj.size(); j++) {
+                if (nAdj[j] != v) continue;
+                nAdj.erase(nAdj.begin() + j);
+                break;
+            }
         }
-        return this->edges[node];
+
+        this->adjMatrix[v].clear();
+        this->adjList[v].clear();
+    }
+
+    bool InterferenceGraph::has_edge(int32_t v1, int32_t v2) {
+        return v2 < this->adjMatrix[v1].size() && this->adjMatrix[v1].test(v2);
+    }
+
+    int32_t InterferenceGraph::get_degree(int32_t node) {
+        return this->adjList[node].size();
+    }
+    
+    std::vector<int32_t> & InterferenceGraph::get_neighbors(int32_t node) {
+        return this->adjList[node];
     }
 
 
     FunctionInterferenceAnalyzer::FunctionInterferenceAnalyzer(
         Function *F,
-        LiveSet &KILL,
-        LiveSet &IN,
-        LiveSet &OUT)
+        FunctionLivenessAnalyzer & liveness)
     {
         this->F = F;
-        this->KILL = KILL;
-        this->IN = IN;
-        this->OUT = OUT;
-
-        nodes = std::set<Item *>();
-        edges = std::map<Item *, std::set<Item *>>();
+        this->liveness = &liveness;
     }
 
     /**
       *  connect everything in varsA with everything in VarsB
       * */
          
-    void FunctionInterferenceAnalyzer::connect_two_sets(std::set<Item *> &varsA, std::set<Item *> &varsB) 
+    void FunctionInterferenceAnalyzer::connect_two_sets(BitVector &varsA, BitVector &varsB) 
     {
-        for (Item * v1: varsA) {
-            this->nodes.insert(v1);
-            this->edges[v1].insert(varsB.begin(), varsB.end());
-            this->edges[v1].erase(v1);
-        }
+        std::vector<int32_t> indices;
 
-        for (Item * v2: varsB) {
-            this->nodes.insert(v2);
-            this->edges[v2].insert(varsA.begin(), varsA.end());
-            this->edges[v2].erase(v2);
+        varsA.to_indices(indices);
+        for (int32_t v1 : indices) {
+            this->intGraph.connect(v1, varsB);
         }
 
+        indices.clear();
+        varsB.to_indices(indices);
+        for (int32_t v2 : indices) {
+            this->intGraph.connect(v2, varsA);
+        }
     }
 
     /**
      *  fully connect everything in vars with every other variables.
      * */
-    void FunctionInterferenceAnalyzer::full_connect(std::set<Item *> &vars)
+    void FunctionInterferenceAnalyzer::full_connect(BitVector &vars)
     {
-        for (Item *var : vars) {
-            this->nodes.insert(var);
+        std::vector<int32_t> indices;
+        vars.to_indices(indices);
+
+        for (int32_t v : indices) {
+            this->intGraph.connect(v, vars);
         }
+    }
 
-        for (Item *a : vars) {
-            for (Item *b : vars) {
-                if (a != b) {
-                    this->edges[a].insert(b);
-                    this->edges[b].insert(a);
-                }
+    BitVector FunctionInterferenceAnalyzer::GP_registers_bits(Item * except) {
+        BitVector regs(this->intGraph.node_num());
+
+        for (Item * reg : GP_regs) {
+            if (reg != except) {
+                regs.set(this->intGraph.get_index(reg));
             }
         }
+        return regs;
     }
 
     /**
      *  Add connections within GP registers
      * */
     void FunctionInterferenceAnalyzer::add_GPRegisters_edges() {
-        std::set<Item *> GP_reg_set(std::begin(GP_regs), std::end(GP_regs));
+        BitVector GP_reg_set = this->GP_registers_bits(NULL);
 
         this->full_connect(GP_reg_set);
     }
 
     /**
      *  Connect two variable if they are in the same IN/OUT set
+     *      OUT[i] is skipped when it is IN[i + 1], which is the common case inside a block
      * */
     void FunctionInterferenceAnalyzer::add_INOUT_edges() {
+        std::vector<BitVector> & IN = this->liveness->get_IN_bits();
+        std::vector<BitVector> & OUT = this->liveness->get_OUT_bits();
 
-        for (Instruction * inst : this->F->instructions) {
-            this->full_connect(this->IN[inst]);
-            this->full_connect(this->OUT[inst]);
+        for (int32_t i = 0; i < IN.size(); i++) {
+            this->full_connect(IN[i]);
+
+            if (i + 1 < IN.size() && OUT[i] == IN[i + 1]) continue;
+            this->full_connect(OUT[i]);
         }
     }
     
@@ -850,18 +1226,19 @@ OUT[return] = {}
      *  Connect every vars KILL[i] to OUT[i]
      * */
     void FunctionInterferenceAnalyzer::add_KILLOUT_edges() {
+        std::vector<BitVector> & KILL = this->liveness->get_KILL_bits();
+        std::vector<BitVector> & OUT = this->liveness->get_OUT_bits();
 
-        for (Instruction * inst : this->F->instructions) {
+        for (int32_t i = 0; i < KILL.size(); i++) {
             this->connect_two_sets(
-                this->KILL[inst],
-                this->OUT[inst]
+                KILL[i],
+                OUT[i]
             );
         }
     }
 
     void FunctionInterferenceAnalyzer::add_shift_edges() {
-        std::set<Item *> GP_reg_no_rcx(std::begin(GP_regs), std::end(GP_regs));
-        GP_reg_no_rcx.erase(& L2::reg_rcx);
+        BitVector GP_reg_no_rcx = this->GP_registers_bits(& L2::reg_rcx);
 
         for(Instruction * inst : this->F->instructions) {
             if (inst->type == InstType::inst_sop) {
@@ -869,7 +1246,8 @@ OUT[return] = {}
 
                 if (IS_REG_VAR(sop->offset)) {
 
-                    std::set<Item *> single_wrapper = {sop->offset};
+                    BitVector single_wrapper(this->intGraph.node_num());
+                    single_wrapper.set(this->intGraph.get_index(sop->offset));
                     this->connect_two_sets(GP_reg_no_rcx, single_wrapper);
 
                 }        
@@ -879,33 +1257,110 @@ OUT[return] = {}
     }
 
     void FunctionInterferenceAnalyzer::build_Inteference_graph() {
+        /**
+         *  nodes: every register/variable seen by liveness (same indices) plus the GP registers
+         * */
+        std::vector<Item *> nodes = this->liveness->get_items();
+        std::set<Item *> seen(nodes.begin(), nodes.end());
+        for (Item * reg : GP_regs) {
+            if (!IN_SET(seen, reg)) {
+                nodes.push_back(reg);
+            }
+        }
+        this->intGraph = InterferenceGraph(nodes);
+
         this->add_GPRegisters_edges();
         this->add_INOUT_edges();
         this->add_KILLOUT_edges();
         this->add_shift_edges();
+
+        this->intGraph.finalize();
     }
 
-    /**
-     *  TODO: Optimize for future performance 
-     * */
-    InterferenceGraph FunctionInterferenceAnalyzer::getIntGraph() {
-        InterferenceGraph intG (
-            this->nodes,
-            this->edges
-        );
-        return intG;
+    void FunctionInterferenceAnalyzer::update_after_spill(
+        Item * spilled,
+        std::vector<int32_t> & touched,
+        std::vector<int32_t> & changedSlots
+    ) {
+        std::vector<Item *> & items = this->liveness->get_items();
+        int32_t firstNew = items.size();
+
+        this->liveness->update_after_spill(spilled, touched, changedSlots);
+
+        int32_t spilledNode = this->intGraph.get_index(spilled);
+        if (spilledNode >= 0) {
+            this->intGraph.isolate(spilledNode);
+        }
+
+        for (int32_t k = firstNew; k < items.size(); k++) {
+            if (this->intGraph.get_index(items[k]) < 0) {
+                this->intGraph.add_node(items[k]);
+            }
+        }
+
+        /**
+         *  same rules as the full build, restricted to edges of a temporary
+         * */
+        std::vector<BitVector> & KILL = this->liveness->get_KILL_bits();
+        std::vector<BitVector> & IN = this->liveness->get_IN_bits();
+        std::vector<BitVector> & OUT = this->liveness->get_OUT_bits();
+
+        for (int32_t slot : changedSlots) {
+            this->connect_new_items(IN[slot], IN[slot], firstNew);
+            this->connect_new_items(OUT[slot], OUT[slot], firstNew);
+            this->connect_new_items(KILL[slot], OUT[slot], firstNew);
+            this->connect_new_items(OUT[slot], KILL[slot], firstNew);
+        }
+
+        BitVector GP_reg_no_rcx = this->GP_registers_bits(& L2::reg_rcx);
+        for (int32_t p : touched) {
+            Instruction * inst = this->F->instructions[p];
+            if (inst->type != InstType::inst_sop) continue;
+
+            Item * offset = ((Instruction_sop *) inst)->offset;
+            int32_t offsetNode = this->intGraph.get_index(offset);
+            if (!IS_REG_VAR(offset) || offsetNode < 0) continue;
+
+            std::vector<int32_t> regs;
+            GP_reg_no_rcx.to_indices(regs);
+            for (int32_t r : regs) {
+                this->intGraph.add_edge(offsetNode, r);
+            }
+        }
+    }
+
+    void FunctionInterferenceAnalyzer::connect_new_items(BitVector & varsA, BitVector & varsB, int32_t firstNew) {
+        std::vector<Item *> & items = this->liveness->get_items();
+        std::vector<int32_t> indicesA;
+        std::vector<int32_t> indicesB;
+
+        varsA.to_indices(indicesA);
+        for (int32_t a : indicesA) {
+            if (a < firstNew) continue;
+
+            if (indicesB.empty()) varsB.to_indices(indicesB);
+
+            int32_t aNode = this->intGraph.get_index(items[a]);
+            for (int32_t b : indicesB) {
+                this->intGraph.add_edge(aNode, this->intGraph.get_index(items[b]));
+            }
+        }
+    }
+
+    InterferenceGraph & FunctionInterferenceAnalyzer::getIntGraph() {
+        return this->intGraph;
     }
 
     void FunctionInterferenceAnalyzer::output_Inteference() {
         // (*it)->accept(this->item_output_visitor);
 
-        for (Item * node : this->nodes) {
+        for (int32_t node = 0; node < this->intGraph.node_num(); node++) {
 
-            node->accept(this->item_output_visitor);
+            this->intGraph.get_node(node)->accept(this->item_output_visitor);
             std::cout << ' ';
             
-            for (Item * v: this->edges[node]) {
-                std::cout << v->to_string();
+            for (int32_t v: this->intGraph.get_neighbors(node)) {
+                std::cout << this->intGraph.get_node(v)->to_string();
                 // v->accept(this->item_output_visitor);
                 
                 std::cout << ' ';
@@ -957,9 +1412,7 @@ OUT[return] = {}
              * */
             FunctionInterferenceAnalyzer int_analyzer(
                 f,
-                live_analyzer.get_live_KILL(),
-                live_analyzer.get_live_IN(),
-                live_analyzer.get_live_OUT()
+                live_analyzer
             );
 
             /**
@@ -7,6 +7,7 @@
 #include <vector>
 #include "L2.h"
 #include "utils.h"
+#include "bit_vector.h"
 
 namespace L2
 {
@@ -79,6 +80,22 @@ namespace L2
         std::unordered_map<Item *, Instruction*> label2Inst;
     };
 
+    /**
+     *  Straight-line run of instructions [first, last] of a function
+     *      liveness sets are indexed by the dense numbering of FunctionLivenessAnalyzer
+     * */
+    struct LiveBlock {
+        int32_t first;
+        int32_t last;
+        std::vector<int32_t> succs;
+        std::vector<int32_t> preds;
+
+        BitVector GEN;
+        BitVector KILL;
+        BitVector IN;
+        BitVector OUT;
+    };
+
     class FunctionLivenessAnalyzer
     {
     public:
@@ -90,45 +107,162 @@ namespace L2
 
         FunctionLivenessAnalyzer(Function *F);
         
+        /**
+         *  set views of the result, keyed by instruction
+         *      built from the bit vectors on first use
+         * */
         LiveSet & get_live_KILL();
         LiveSet & get_live_IN();
         LiveSet & get_live_OUT();
+
+        /**
+         *  dense views of the result
+         *      every register/variable of F has an index into get_items()
+         *      the bit vectors are indexed by the slot of the instruction (see get_slot)
+         * */
+        std::vector<Item *> & get_items();
+        std::vector<BitVector> & get_GEN_bits();
+        std::vector<BitVector> & get_KILL_bits();
+        std::vector<BitVector> & get_IN_bits();
+        std::vector<BitVector> & get_OUT_bits();
+
+        /**
+         *  estimated loop nesting depth of every instruction
+         *      a jump back to an earlier block closes a natural loop
+         * */
+        std::vector<int32_t> & get_loop_depths();
+
+        /**
+         *  index of @inst into the bit vectors, -1 if it was never analyzed
+         *      the position of @inst in F->instructions until update_after_spill
+         *      gives the instructions it inserts new indices at the end
+         * */
+        int32_t get_slot(Instruction * inst);
+
+        /**
+         *  patch the result after the spiller replaced @spilled in F
+         *      @touched are the increasing positions in F->instructions of every
+         *      instruction the spiller inserted or rewrote; only they and the
+         *      instructions inside the live ranges of the new temporaries are
+         *      recomputed, the temporaries never leave their block
+         *      @changedSlots will contain the slots whose sets changed
+         * */
+        void update_after_spill(
+            Item * spilled,
+            std::vector<int32_t> & touched,
+            std::vector<int32_t> & changedSlots
+        );
+
+        /**
+         *  items removed by update_after_spill, they may remain in the
+         *      sets of the instructions that were not recomputed
+         * */
+        BitVector & get_dead_items();
     private:
         Function *F;
 
         LiveSet IN;
         LiveSet OUT;
+        bool setsBuilt;
+
+        std::vector<Item *> items;
+        std::unordered_map<Item *, int32_t> item2idx;
+
+        std::vector<BitVector> instGEN;
+        std::vector<BitVector> instKILL;
+        std::vector<BitVector> instIN;
+        std::vector<BitVector> instOUT;
+
+        std::unordered_map<Instruction *, int32_t> inst2slot;
+        BitVector deadItems;
+
+        std::vector<LiveBlock> blocks;
+        std::vector<int32_t> loopDepths;
 
         LivenessVisitor live_visitor;
         ItemOutputVisitor item_output_visitor;
 
         SuccessorVisitor succVisitor;
+
+        /**
+         *  give every register/variable in GEN/KILL a dense index
+         *      and translate GEN/KILL into bit vectors
+         * */
+        void number_items();
+
+        /**
+         *  split F into basic blocks using the successors of each instruction
+         * */
+        void build_blocks();
+
+        void calculate_loop_depths();
+        void build_sets();
+        void output_bits(BitVector & bits);
     };
     
+    /**
+     *  Interference graph over a fixed set of nodes
+     *      an adjacency bit-matrix answers "do a and b interfere" in O(1)
+     *      and adjacency vectors list the neighbors of a node in O(degree)
+     * */
     class InterferenceGraph {
         public:
             InterferenceGraph();
             
-            InterferenceGraph(
-                std::set<Item *> & nodes,
-                std::map<Item *, std::set<Item *>> & edges
-            );
+            /**
+             *  @nodes[i] becomes node i
+             * */
+            InterferenceGraph(std::vector<Item *> & nodes);
+
+            int32_t node_num();
+            Item * get_node(int32_t idx);
+
+            /**
+             *  index of @node, -1 if it is not in the graph
+             * */
+            int32_t get_index(Item * node);
 
             bool add_edge(Item *v1, Item *v2);
-            bool remove_edge();
-            bool remove_node(Item * toRemove);
 
             /**
-             *  populate the stats map
-             *      where @edgeCnt2nodes will be populated as a map from number of edges 
-             *          to a set of nodes that have such number of edges
+             *  add the edge (v1, v2), false if it is already there
+             *      keeps the adjacency vectors in sync, so coalescing
+             *      can keep adding edges after finalize()
              * */
-            void get_nodes_stats(std::map<int32_t, std::set<Item * >> & edgeCnt2nodes);
+            bool add_edge(int32_t v1, int32_t v2);
 
-            std::set<Item *> & get_neighbors(Item * node);
+            /**
+             *  add the edges (v, u) for every u in @others
+             *      bits beyond the end of @others are treated as 0
+             *      the reverse edges are the caller's business
+             * */
+            void connect(int32_t v, BitVector & others);
+
+            /**
+             *  drop self loops and build the adjacency vectors
+             *      must be called once every edge has been added
+             * */
+            void finalize();
+
+            /**
+             *  append @node with no edge, return its index
+             * */
+            int32_t add_node(Item * node);
+
+            /**
+             *  remove every edge of @v
+             * */
+            void isolate(int32_t v);
+
+            bool has_edge(int32_t v1, int32_t v2);
+            int32_t get_degree(int32_t node);
+            std::vector<int32_t> & get_neighbors(int32_t node);
         private:
-            std::set<Item *> nodes;
-            std::map<Item *, std::set<Item *>> edges;
+            std::vector<Item *> nodes;
+            std::unordered_map<Item *, int32_t> node2idx;
+
+            std::vector<BitVector> adjMatrix;
+            std::vector<std::vector<int32_t>> adjList;
     };
     
 
@@ -136,45 +270,63 @@ namespace L2
     public:    
         FunctionInterferenceAnalyzer(
             Function * F,
-            LiveSet & KILL,
-            LiveSet & IN,
-            LiveSet & OUT
+            FunctionLivenessAnalyzer & liveness
         );
 
         void build_Inteference_graph();
         void output_Inteference();
 
-        InterferenceGraph getIntGraph();
+        /**
+         *  bring the graph up to date after the spiller replaced @spilled
+         *      (see FunctionLivenessAnalyzer::update_after_spill)
+         *      the other items keep their live ranges, so @spilled loses its edges
+         *      and only the new temporaries get edges from the recomputed sets
+         *      @changedSlots will contain the slots whose sets changed
+         * */
+        void update_after_spill(
+            Item * spilled,
+            std::vector<int32_t> & touched,
+            std::vector<int32_t> & changedSlots
+        );
+
+        InterferenceGraph & getIntGraph();
         
         private:
             
             Function * F;
 
             /**
-             *  Input from FunctionAnalyzer
+             *  Input from FunctionLivenessAnalyzer
+             *      its item numbering is reused as the node numbering of the graph
              * */
-            // LiveSet GEN;
-            LiveSet KILL;
-            LiveSet IN;
-            LiveSet OUT;
+            FunctionLivenessAnalyzer * liveness;
 
             ItemOutputVisitor item_output_visitor;
 
             /**
              *  Inteference Graph data structure
              * */
-            std::set<Item *> nodes;
-            std::map<Item *, std::set<Item *>> edges;
+            InterferenceGraph intGraph;
 
             /**
              *  connect everything in varsA with everything in VarsB
              * */
-            void connect_two_sets(std::set<Item *> & varsA, std::set<Item *> & varsB);
+            void connect_two_sets(BitVector & varsA, BitVector & varsB);
 
             /**
              *  fully connect everything in vars with every other variables.
              * */
-            void full_connect(std::set<Item *> & vars);
+            void full_connect(BitVector & vars);
+
+            /**
+             *  connect every item of varsA numbered from @firstNew with everything in varsB
+             * */
+            void connect_new_items(BitVector & varsA, BitVector & varsB, int32_t firstNew);
+
+            /**
+             *  bit vector of the GP registers, optionally without @except
+             * */
+            BitVector GP_registers_bits(Item * except);
 
             /**
              *  Add connections within GP registers
@@ -0,0 +1,113 @@
+#include "bit_vector.h"
+
+#define WORD_BITS 64
+#define WORD_NUM(nbits) (((nbits) + WORD_BITS - 1) / WORD_BITS)
+#define WORD_IDX(idx) ((idx) / WORD_BITS)
+#define BIT_MASK(idx) (((uint64_t) 1) << ((idx) % WORD_BITS))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+namespace L2
+{
+    BitVector::BitVector() {
+        this->nbits = 0;
+    }
+
+    BitVector::BitVector(int32_t size) {
+        this->resize(size);
+    }
+
+    void BitVector::resize(int32_t size) {
+        this->nbits = size;
+        this->words.assign(WORD_NUM(size), 0);
+    }
+
+    void BitVector::grow(int32_t size) {
+        if (size <= this->nbits) return;
+
+        this->nbits = size;
+        this->words.resize(WORD_NUM(size), 0);
+    }
+
+    int32_t BitVector::size() const {
+        return this->nbits;
+    }
+
+    void BitVector::set(int32_t idx) {
+        this->words[WORD_IDX(idx)] |= BIT_MASK(idx);
+    }
+
+    void BitVector::reset(int32_t idx) {
+        this->words[WORD_IDX(idx)] &= ~BIT_MASK(idx);
+    }
+
+    bool BitVector::test(int32_t idx) const {
+        return (this->words[WORD_IDX(idx)] & BIT_MASK(idx)) != 0;
+    }
+
+    void BitVector::clear() {
+        for (uint64_t & w : this->words) {
+            w = 0;
+        }
+    }
+
+    bool BitVector::empty() const {
+        for (uint64_t w : this->words) {
+            if (w) return false;
+        }
+        return true;
+    }
+
+    int32_t BitVector::count() const {
+        int32_t cnt = 0;
+        for (uint64_t w : this->words) {
+            cnt += __builtin_popcountll(w);
+        }
+        return cnt;
+    }
+
+    bool BitVector::union_with(const BitVector & other) {
+        bool changed = false;
+        uint32_t wordNum = MIN(this->words.size(), other.words.size());
+        for (uint32_t i = 0; i < wordNum; i++) {
+            uint64_t w = this->words[i] | other.words[i];
+            changed = changed || (w != this->words[i]);
+            this->words[i] = w;
+        }
+        return changed;
+    }
+
+    void BitVector::subtract(const BitVector & other) {
+        for (uint32_t i = 0; i < this->words.size(); i++) {
+            this->words[i] &= ~other.words[i];
+        }
+    }
+
+    bool BitVector::assign_transfer(const BitVector & gen, const BitVector & out, const BitVector & kill) {
+        bool changed = false;
+        for (uint32_t i = 0; i < this->words.size(); i++) {
+            uint64_t w = gen.words[i] | (out.words[i] & ~kill.words[i]);
+            changed = changed || (w != this->words[i]);
+            this->words[i] = w;
+        }
+        return changed;
+    }
+
+    void BitVector::to_indices(std::vector<int32_t> & indices) const {
+        for (uint32_t i = 0; i < this->words.size(); i++) {
+            uint64_t w = this->words[i];
+            while (w) {
+                int32_t bit = __builtin_ctzll(w);
+                indices.push_back(i * WORD_BITS + bit);
+                w &= w - 1;
+            }
+        }
+    }
+
+    bool BitVector::operator==(const BitVector & other) const {
+        return this->nbits == other.nbits && this->words == other.words;
+    }
+
+    bool BitVector::operator!=(const BitVector & other) const {
+        return !(*this == other);
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace L2
+{
+    /**
+     *  Fixed-size packed set of small integers
+     *      used by the analyses once every register/variable of a function
+     *      has been given a dense index
+     * */
+    class BitVector {
+        public:
+            BitVector();
+            BitVector(int32_t size);
+
+            void resize(int32_t size);
+
+            /**
+             *  make room for indices below @size, keeping the bits already set
+             * */
+            void grow(int32_t size);
+            int32_t size() const;
+
+            void set(int32_t idx);
+            void reset(int32_t idx);
+            bool test(int32_t idx) const;
+
+            void clear();
+            bool empty() const;
+            int32_t count() const;
+
+            /**
+             *  this = this U other
+             *      other may be shorter, its missing bits are 0
+             *      return whether this changed
+             * */
+            bool union_with(const BitVector & other);
+
+            /**
+             *  this = this - other
+             * */
+            void subtract(const BitVector & other);
+
+            /**
+             *  this = gen U (out - kill)
+             *      return whether this changed
+             * */
+            bool assign_transfer(const BitVector & gen, const BitVector & out, const BitVector & kill);
+
+            /**
+             *  append the index of every set bit to @indices in increasing order
+             * */
+            void to_indices(std::vector<int32_t> & indices) const;
+
+            bool operator==(const BitVector & other) const;
+            bool operator!=(const BitVector & other) const;
+
+        private:
+            int32_t nbits;
+            std::vector<uint64_t> words;
+    };
+}
@@ -19,7 +19,7 @@ namespace L2 {
         this->out = NULL;
     }
     
-    L2ToL1_GeneratorVisitor::L2ToL1_GeneratorVisitor(std::ofstream *outputFile) {
+    L2ToL1_GeneratorVisitor::L2ToL1_GeneratorVisitor(std::ostream *outputFile) {
         this->out = outputFile;
     }
 
@@ -106,7 +106,7 @@ namespace L2 {
     //     this->instGenerator = L2ToL1_GeneratorVisitor(&this->out);
     // }
 
-    CodeGenerator_L2ToL1::CodeGenerator_L2ToL1(std::ofstream * out, Program * p){
+    CodeGenerator_L2ToL1::CodeGenerator_L2ToL1(std::ostream * out, Program * p){
         this->out = out;
         this->p = p;
         this->instGenerator = L2ToL1_GeneratorVisitor(this->out);
@@ -138,8 +138,13 @@ namespace L2 {
         *this->out << "\n";
     }
     
-    void CodeGenerator_L2ToL1::close() {
-        this->out->close();
+    void generate_code(Program & p, std::ostream & out){
+        CodeGenerator_L2ToL1 gen(
+            &out,
+            &p
+        );
+
+        gen.generate();
     }
 
     void generate_code(Program & p){
@@ -150,13 +155,8 @@ namespace L2 {
         std::ofstream outputFile;
         outputFile.open("prog.L1");
 
-        CodeGenerator_L2ToL1 gen(
-            &outputFile,
-            &p
-        );
-
-        gen.generate();
-        gen.close();
+        generate_code(p, outputFile);
+        outputFile.close();
          
         /* 
         * Generate target code
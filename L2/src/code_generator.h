@@ -9,6 +9,7 @@
 namespace L2{
 
     void generate_code(Program & p);
+    void generate_code(Program & p, std::ostream & out);
 
     class L2ToL1_GeneratorVisitor : public InstVisitor
     {
@@ -27,11 +28,11 @@ namespace L2{
             void visit(Instruction_cjump *) override;
 
             L2ToL1_GeneratorVisitor();
-            L2ToL1_GeneratorVisitor(std::ofstream * outputFile);
+            L2ToL1_GeneratorVisitor(std::ostream * outputFile);
 
             void set_numlocals(int32_t numlocals);
         private:
-            std::ofstream *out;
+            std::ostream *out;
             int32_t numlocals;
 
     };
@@ -39,12 +40,11 @@ namespace L2{
     class CodeGenerator_L2ToL1 {
         public:
             // CodeGenerator_L2ToL1 (std::string outFilename, Program * p);
-            CodeGenerator_L2ToL1(std::ofstream * out, Program * p);
+            CodeGenerator_L2ToL1(std::ostream * out, Program * p);
 
             void generate();
-            void close();
         private:
-            std::ofstream *out;
+            std::ostream *out;
             L2ToL1_GeneratorVisitor instGenerator;
             Program * p;
     };
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include "linear_scan.h"
+
+#define IN_SET(set, key) (set.find(key) != set.end())
+
+namespace L2 {
+
+    LinearScanSelector::LinearScanSelector(
+        Function * F,
+        FunctionLivenessAnalyzer * liveness,
+        std::set<Item *> * prevSpillReplace
+    ) {
+        this->liveness = liveness;
+        this->prevSpillReplace = prevSpillReplace;
+
+        for (Instruction * inst : F->instructions) {
+            if (inst->type != InstType::inst_sop) continue;
+
+            Item * offset = ((Instruction_sop *) inst)->offset;
+            if (offset->itemtype == ItemType::item_variable) {
+                this->shiftAmounts.insert(offset);
+            }
+        }
+
+        this->build_intervals();
+    }
+
+    void LinearScanSelector::build_intervals() {
+        std::vector<Item *> & items = this->liveness->get_items();
+        std::vector<BitVector> & IN = this->liveness->get_IN_bits();
+        std::vector<BitVector> & OUT = this->liveness->get_OUT_bits();
+        std::vector<BitVector> & KILL = this->liveness->get_KILL_bits();
+        int32_t instNum = IN.size();
+
+        std::vector<int32_t> start(items.size(), -1);
+        std::vector<int32_t> end(items.size(), -1);
+        std::vector<bool> busy(items.size());
+        std::vector<int32_t> indices;
+
+        this->busyPrefix.assign(L2::COLOR_NUM, std::vector<int32_t>(instNum + 1, 0));
+
+        std::vector<std::pair<int32_t, Color>> registers;
+        for (int32_t k = 0; k < items.size(); k++) {
+            auto it = reg2color.find(items[k]);
+            if (it != reg2color.end()) {
+                registers.push_back({k, it->second});
+            }
+        }
+
+        for (int32_t i = 0; i < instNum; i++) {
+            indices.clear();
+            IN[i].to_indices(indices);
+            OUT[i].to_indices(indices);
+            KILL[i].to_indices(indices);
+
+            for (int32_t k : indices) {
+                if (start[k] < 0) start[k] = i;
+                end[k] = i;
+                busy[k] = true;
+            }
+
+            for (auto & reg : registers) {
+                this->busyPrefix[reg.second][i + 1] = busy[reg.first] ? 1 : 0;
+            }
+
+            for (int32_t k : indices) {
+                busy[k] = false;
+            }
+        }
+
+        for (int32_t c = 0; c < L2::COLOR_NUM; c++) {
+            for (int32_t i = 0; i < instNum; i++) {
+                this->busyPrefix[c][i + 1] += this->busyPrefix[c][i];
+            }
+        }
+
+        for (int32_t k = 0; k < items.size(); k++) {
+            if (items[k]->itemtype != ItemType::item_variable || start[k] < 0) continue;
+            this->intervals.push_back({k, start[k], end[k]});
+        }
+
+        std::sort(
+            this->intervals.begin(),
+            this->intervals.end(),
+            [](const Interval & a, const Interval & b) {
+                return a.start < b.start || (a.start == b.start && a.item < b.item);
+            }
+        );
+    }
+
+    bool LinearScanSelector::register_free(Color c, Interval & interval) {
+        return this->busyPrefix[c][interval.end + 1] == this->busyPrefix[c][interval.start];
+    }
+
+    bool LinearScanSelector::register_allowed(Color c, Interval & interval) {
+        if (c != rcx_color && IN_SET(this->shiftAmounts, this->liveness->get_items()[interval.item])) {
+            return false;
+        }
+        return this->register_free(c, interval);
+    }
+
+    bool LinearScanSelector::spillable(Interval & interval) {
+        return !IN_SET((*this->prevSpillReplace), this->liveness->get_items()[interval.item]);
+    }
+
+    bool LinearScanSelector::assignColorForAll(
+        std::unordered_map<Item *, Color> & item2color,         /*output*/
+        std::set<Item *> & NonColorItems                       /*output*/
+    ) {
+        std::vector<Item *> & items = this->liveness->get_items();
+
+        /**
+         *  active intervals and the color each of them holds
+         * */
+        std::vector<int32_t> active;
+        std::vector<Color> activeColor;
+        bool taken[L2::COLOR_NUM];
+
+        for (int32_t v = 0; v < this->intervals.size(); v++) {
+            Interval & cur = this->intervals[v];
+
+            /**
+             *  expire the intervals that ended before cur starts
+             * */
+            int32_t kept = 0;
+            for (int32_t a = 0; a < active.size(); a++) {
+                if (this->intervals[active[a]].end < cur.start) continue;
+                active[kept] = active[a];
+                activeColor[kept] = activeColor[a];
+                kept++;
+            }
+            active.resize(kept);
+            activeColor.resize(kept);
+
+            std::fill(taken, taken + L2::COLOR_NUM, false);
+            for (Color c : activeColor) {
+                taken[c] = true;
+            }
+
+            bool found_color = false;
+            for (Color c : this->sorted_color) {
+                if (!taken[c] && this->register_allowed(c, cur)) {
+                    item2color[items[cur.item]] = c;
+                    active.push_back(v);
+                    activeColor.push_back(c);
+                    found_color = true;
+                    break;
+                }
+            }
+            if (found_color) continue;
+
+            /**
+             *  no register left: take the one of the active interval ending last
+             *      if it outlives cur; a variable created by spilling takes
+             *      any register it can use
+             * */
+            int32_t victim = -1;
+            for (int32_t a = 0; a < active.size(); a++) {
+                Interval & candidate = this->intervals[active[a]];
+                if (!this->spillable(candidate) || !this->register_allowed(activeColor[a], cur)) continue;
+                if (this->spillable(cur) && candidate.end <= cur.end) continue;
+
+                if (victim < 0 || candidate.end > this->intervals[active[victim]].end) {
+                    victim = a;
+                }
+            }
+
+            if (victim < 0) {
+                NonColorItems.insert(items[cur.item]);
+                continue;
+            }
+
+            Item * victimItem = items[this->intervals[active[victim]].item];
+            item2color.erase(victimItem);
+            NonColorItems.insert(victimItem);
+
+            item2color[items[cur.item]] = activeColor[victim];
+            active[victim] = v;
+        }
+
+        return NonColorItems.empty();
+    }
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <set>
+#include <unordered_map>
+#include "analysis.h"
+#include "register_allocation.h"
+
+namespace L2 {
+
+    /**
+     *  default instruction count from which -O 1 allocates a function with linear scan
+     * */
+    const int64_t LINEAR_SCAN_THRESHOLD = 1000;
+
+    /**
+     *  Linear scan over the instruction numbering of a function
+     *      the interval of a variable spans every instruction where it is
+     *      live or defined, loops included since liveness already covers them;
+     *      a register is busy wherever it is live or written
+     * */
+    class LinearScanSelector {
+        public:
+            /**
+             *  variables in @prevSpillReplace were created by spilling,
+             *      they never give their register away
+             * */
+            LinearScanSelector(
+                Function * F,
+                FunctionLivenessAnalyzer * liveness,
+                std::set<Item *> * prevSpillReplace
+            );
+
+            /**
+             *  Try to assign colors for all variables
+             *      if failed return false; otherwise true
+             *      @NonColorItems will contain the variables that got no register
+             *      @item2color will contain mapping from variable to its color
+             * */
+            bool assignColorForAll(
+                std::unordered_map<Item *, Color> & item2color,
+                std::set<Item *> & NonColorItems
+            );
+
+        private:
+            struct Interval {
+                int32_t item;
+                int32_t start;
+                int32_t end;
+            };
+
+            FunctionLivenessAnalyzer * liveness;
+            std::set<Item *> * prevSpillReplace;
+
+            std::vector<Interval> intervals;
+
+            /**
+             *  variables used as a shift amount can only live in rcx
+             * */
+            std::set<Item *> shiftAmounts;
+
+            /**
+             *  busyPrefix[c][i] = number of instructions before i where register c is busy
+             * */
+            std::vector<std::vector<int32_t>> busyPrefix;
+
+            void build_intervals();
+            bool register_free(Color c, Interval & interval);
+            bool register_allowed(Color c, Interval & interval);
+            bool spillable(Interval & interval);
+
+            Color sorted_color[L2::COLOR_NUM] = {
+                r10_color,
+                r11_color,
+                r8_color,
+                r9_color,
+                rax_color,
+                rcx_color,
+                rdi_color,
+                rdx_color,
+                rsi_color,
+                rbx_color,
+                rbp_color,
+                r12_color,
+                r13_color,
+                r14_color,
+                r15_color
+            };
+    };
+
+}
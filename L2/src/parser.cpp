@@ -1745,6 +1745,23 @@ namespace L2 {
     return p;
     }
 
+    Program parse_string (const std::string & source, const std::string & sourceName){
+
+    /* 
+     * Check the grammar for some possible issues.
+     */
+    pegtl::analyze< grammar >();
+
+    /*
+     * Parse.
+     */   
+    memory_input< > memInput(source, sourceName);
+    Program p;
+    parse< grammar, action >(memInput, p);
+
+    return p;
+    }
+
     Program parse_function_file (char *fileName){
         // std::cerr << "parse function file" << fileName << '\n';
         /* 
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <string>
+
 #include "L2.h"
 
 namespace L2{
     Program parse_file (char *fileName);
+    Program parse_string (const std::string & source, const std::string & sourceName);
     Program parse_function_file (char *fileName);
     Program parse_spill_file(char *fileName);
 }
@@ -0,0 +1,15 @@
+#include <pipeline.h>
+#include <parser.h>
+#include <register_allocation.h>
+#include <code_generator.h>
+
+namespace L2{
+
+    void compile_source(const std::string & source, const std::string & sourceName, std::ostream & out){
+        auto p = L2::parse_string(source, sourceName);
+
+        L2::run_register_allocation(p, L2::spill_split_blocks, -1);
+        L2::generate_code(p, out);
+    }
+
+}
@@ -1,9 +1,18 @@
 
 #include "register_allocation.h"
+#include "linear_scan.h"
 
 #define IN_MAP(map, key) (map.find(key) != map.end())
 #define IN_SET(set, key) (set.find(key) != set.end())
 
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/**
+ *  deeper loops weigh the same as this depth
+ * */
+#define MAX_LOOP_WEIGHT_DEPTH 8
+
 // #define REG_DEBUG 0
 
 #ifdef REG_DEBUG
@@ -46,7 +55,7 @@ namespace L2 {
         {r14_color, &reg_r14},
         {r15_color, &reg_r15},
         {rbp_color, &reg_rbp},
-        {rbx_color, &reg_rbp}
+        {rbx_color, &reg_rbx}
     };
 
 
@@ -246,9 +255,10 @@ namespace L2 {
     }
 
 
-    RegisterAllocator::RegisterAllocator(Function * F, Function ** F_addr) {
+    RegisterAllocator::RegisterAllocator(Function * F, Function ** F_addr, SpillMode spillMode) {
         this->F = F;
         this->F_addr = F_addr;
+        this->spillMode = spillMode;
     }
     
 
@@ -298,7 +308,7 @@ namespace L2 {
     //         DEBUG_OUT << "Done: " << "Interference Graph!" << '\n';
             
 
-    //         InterferenceGraph intGraph = int_analyzer.getIntGraph();
+    //         InterferenceGraph & intGraph = int_analyzer.getIntGraph();
     //         std::stack<Item *>  nodeStack;
     //         std::unordered_map<Item *, Color> item2color;
     //         std::set<Item *> NonColorItems;
@@ -398,9 +408,55 @@ namespace L2 {
 
     // }
     
+    static double loop_weight(int32_t depth) {
+        double weight = 1;
+        for (int32_t d = MIN(depth, MAX_LOOP_WEIGHT_DEPTH); d > 0; d--) {
+            weight *= 10;
+        }
+        return weight;
+    }
+
+    void RegisterAllocator::compute_spill_costs(
+        FunctionLivenessAnalyzer & live_analyzer,
+        InterferenceGraph & intGraph,
+        std::set<Item *> & prevSpillReplace,
+        std::vector<double> & spillCost
+    ) {
+        std::vector<Item *> & items = live_analyzer.get_items();
+        std::vector<BitVector> & GEN = live_analyzer.get_GEN_bits();
+        std::vector<BitVector> & KILL = live_analyzer.get_KILL_bits();
+        std::vector<int32_t> & loopDepths = live_analyzer.get_loop_depths();
+
+        /**
+         *  sum the weights per liveness item, then move them to the graph nodes
+         * */
+        std::vector<double> itemCost(items.size(), 0);
+        std::vector<int32_t> indices;
+        for (int32_t i = 0; i < loopDepths.size(); i++) {
+            double weight = loop_weight(loopDepths[i]);
+
+            indices.clear();
+            GEN[i].to_indices(indices);
+            KILL[i].to_indices(indices);
+            for (int32_t k : indices) {
+                itemCost[k] += weight;
+            }
+        }
+
+        spillCost.assign(intGraph.node_num(), UNSPILLABLE_COST);
+        for (int32_t k = 0; k < items.size(); k++) {
+            if (items[k]->itemtype != ItemType::item_variable) continue;
+            if (IN_SET(prevSpillReplace, items[k])) continue;
+
+            spillCost[intGraph.get_index(items[k])] = itemCost[k];
+        }
+    }
+
     bool RegisterAllocator::analysisAndColoring(
         Function * F,
-        std::set<Item *> & NonColorItems
+        std::set<Item *> & prevSpillReplace,
+        std::set<Item *> & NonColorItems,
+        std::vector<Item *> & varsToSpill
     ){
         /**
          *  run liveness analysis
@@ -419,9 +475,7 @@ namespace L2 {
          * */
         FunctionInterferenceAnalyzer int_analyzer(
             F,
-            live_analyzer.get_live_KILL(),
-            live_analyzer.get_live_IN(),
-            live_analyzer.get_live_OUT()
+            live_analyzer
         );
 
 
@@ -434,17 +488,57 @@ namespace L2 {
         DEBUG_OUT << "Done: " << "Interference Graph!" << '\n';
 
 
-        InterferenceGraph intGraph = int_analyzer.getIntGraph();
-        std::stack<Item *>  nodeStack;
+        InterferenceGraph & intGraph = int_analyzer.getIntGraph();
         std::unordered_map<Item *, Color> item2color;
-        
+        std::vector<double> spillCost;
+
+        this->compute_spill_costs(
+            live_analyzer,
+            intGraph,
+            prevSpillReplace,
+            spillCost
+        );
+
+        bool AllAssigned = this->color_graph(
+            F,
+            intGraph,
+            spillCost,
+            prevSpillReplace,
+            item2color,
+            NonColorItems,
+            varsToSpill
+        );
+
+        this->color_variables(F, item2color);
+        this->remove_self_moves(F);
+        DEBUG_OUT << "Done: " << "Color variables!" << '\n';
 
+        return AllAssigned;
+    }
+
+    bool RegisterAllocator::color_graph(
+        Function * F,
+        InterferenceGraph & intGraph,
+        std::vector<double> & spillCost,
+        std::set<Item *> & prevSpillReplace,
+        std::unordered_map<Item *, Color> & item2color,
+        std::set<Item *> & NonColorItems,
+        std::vector<Item *> & varsToSpill
+    ){
+        /**
+         *  coalescing adds edges and moves costs around
+         * */
+        InterferenceGraph roundGraph = intGraph;
+        std::vector<double> roundCost = spillCost;
+        std::stack<Item *>  nodeStack;
 
         /**
          *  color_num default to be 15, number of L2 GP register
          * */
         NodeSelector node_selector(
-            intGraph,
+            &roundGraph,
+            F,
+            &roundCost,
             L2::COLOR_NUM
         );
 
@@ -456,8 +550,9 @@ namespace L2 {
         DEBUG_OUT << "Done: " << "Node selection!" << '\n';
 
         ColorSelector color_selector(
-            &intGraph,
-            &nodeStack
+            &roundGraph,
+            &nodeStack,
+            &node_selector
         );
 
         bool AllAssigned = color_selector.assignColorForAll(
@@ -467,17 +562,60 @@ namespace L2 {
 
         DEBUG_OUT << "Done: " << "Assign colors!" << '\n';
 
-
-        this->color_variables(F, item2color);
-        DEBUG_OUT << "Done: " << "Color variables!" << '\n';
+        SpillVarSelector spill_selector(
+            &NonColorItems,
+            &prevSpillReplace,
+            &roundGraph,
+            &roundCost
+        );
+        spill_selector.selectVarsToSpill(varsToSpill);
 
         return AllAssigned;
     }
 
+    void RegisterAllocator::update_spill_costs(
+        FunctionLivenessAnalyzer & live_analyzer,
+        InterferenceGraph & intGraph,
+        std::vector<int32_t> & changedSlots,
+        std::vector<ItemVariable *> & spillableVars,
+        std::vector<double> & spillCost
+    ) {
+        spillCost.resize(intGraph.node_num(), UNSPILLABLE_COST);
+        if (spillableVars.empty()) return;
+
+        std::vector<Item *> & items = live_analyzer.get_items();
+        std::vector<BitVector> & GEN = live_analyzer.get_GEN_bits();
+        std::vector<BitVector> & KILL = live_analyzer.get_KILL_bits();
+        std::vector<int32_t> & loopDepths = live_analyzer.get_loop_depths();
+
+        std::set<Item *> spillable(spillableVars.begin(), spillableVars.end());
+        for (Item * var : spillable) {
+            spillCost[intGraph.get_index(var)] = 0;
+        }
+
+        std::vector<int32_t> indices;
+        for (int32_t slot : changedSlots) {
+            double weight = loop_weight(loopDepths[slot]);
+
+            indices.clear();
+            GEN[slot].to_indices(indices);
+            KILL[slot].to_indices(indices);
+            for (int32_t k : indices) {
+                if (!IN_SET(spillable, items[k])) continue;
+                spillCost[intGraph.get_index(items[k])] += weight;
+            }
+        }
+    }
+
     void RegisterAllocator::allcoate() {
         
         Function * F_copy = this->F->copy();
         bool shouldSpillAll = false;
+
+        /**
+         *  every stack slot from here on is created by spilling
+         * */
+        int64_t firstSpillSlot = this->F->locals;
         /**
          * "%SPILL_VAR_SYMBOL_%d_%d", iteration, index of varsToSpill
          * */
@@ -487,22 +625,48 @@ namespace L2 {
         bool AllAssigned = false;
         
         std::set<Item *> prevSpillReplace;
+        std::set<Item *> splitReplace;
+
+        /**
+         *  liveness and interference are built once,
+         *      each spill patches them around the instructions it rewrote
+         * */
+        FunctionLivenessAnalyzer live_analyzer(this->F);
+        live_analyzer.calculate_GENKILL();
+        live_analyzer.calculate_INOUT();
+
+        FunctionInterferenceAnalyzer int_analyzer(
+            this->F,
+            live_analyzer
+        );
+        int_analyzer.build_Inteference_graph();
+
+        std::vector<double> spillCost;
+        this->compute_spill_costs(
+            live_analyzer,
+            int_analyzer.getIntGraph(),
+            prevSpillReplace,
+            spillCost
+        );
+
+        std::unordered_map<Item *, Color> item2color;
         do {
 
 
             std::set<Item *> NonColorItems;
             std::vector<Item *> varsToSpill;
+            item2color.clear();
 
-            AllAssigned = this->analysisAndColoring(
+            AllAssigned = this->color_graph(
                 this->F,
-                NonColorItems
+                int_analyzer.getIntGraph(),
+                spillCost,
+                prevSpillReplace,
+                item2color,
+                NonColorItems,
+                varsToSpill
             );
 
-
-            SpillVarSelector spill_selector(&NonColorItems, &prevSpillReplace);
-            // spill_selector.
-            spill_selector.selectVarsToSpill(varsToSpill);
-
             if (!NonColorItems.empty() && varsToSpill.empty()) {
                 /***
                  *  Cannot color all variables but cannot spill any variable
@@ -532,20 +696,44 @@ namespace L2 {
                     prefix_str
                 );
                 
+                SpillMode mode = IN_SET(splitReplace, varsToSpill[j]) ? spill_everywhere : this->spillMode;
+                if (rematerializable_value(this->F, (ItemVariable *) varsToSpill[j]) != NULL) {
+                    mode = spill_rematerialize;
+                }
+
                 Spiller sp (
                     this->F,
                     (ItemVariable *) varsToSpill[j],
-                    prefix
+                    prefix,
+                    mode
                 );
 
                 sp.spill_variables();
                 
                 std::vector<ItemVariable *> var_replacements = sp.get_var_replacement();
 
+                std::vector<int32_t> changedSlots;
+                int_analyzer.update_after_spill(
+                    varsToSpill[j],
+                    sp.get_touched(),
+                    changedSlots
+                );
+
                 /**
                  * append variables created by spilling to the prevSpillReplace
+                 *      block temporaries can still be spilled once more
                  * */
-                prevSpillReplace.insert(
+                std::vector<ItemVariable *> noSpillable;
+                this->update_spill_costs(
+                    live_analyzer,
+                    int_analyzer.getIntGraph(),
+                    changedSlots,
+                    (mode == spill_split_blocks) ? var_replacements : noSpillable,
+                    spillCost
+                );
+
+                std::set<Item *> & replaceSet = (mode == spill_split_blocks) ? splitReplace : prevSpillReplace;
+                replaceSet.insert(
                     var_replacements.begin(),
                     var_replacements.end()
                 );
@@ -585,7 +773,8 @@ namespace L2 {
                 Spiller sp (
                     F_copy,
                     (ItemVariable *) allVars[it],
-                    prefix
+                    prefix,
+                    spill_everywhere
                 );
 
                 sp.spill_variables();
@@ -599,18 +788,110 @@ namespace L2 {
 
             this->analysisAndColoring(
                 F_copy,
-                NonColorItems
+                prevSpillReplace,
+                NonColorItems,
+                varsToSpill
             );
             // F_copy->print();
 
+            SpillSlotColorer slot_colorer(F_copy, firstSpillSlot);
+            slot_colorer.share_slots();
+
             *this->F_addr = F_copy;
             return;
         }
+
+        this->color_variables(this->F, item2color);
+        this->remove_self_moves(this->F);
         
-        
+        SpillSlotColorer slot_colorer(this->F, firstSpillSlot);
+        slot_colorer.share_slots();
     }
 
 
+    void RegisterAllocator::linear_scan() {
+        Function * F_copy = this->F->copy();
+        int64_t firstSpillSlot = this->F->locals;
+
+        /**
+         * "%SPILL_VAR_SYMBOL_%d_%d", iteration, index of varsToSpill
+         * */
+        std::string SpillPrefixPre = "%SPILL_VAR_SYMBOL_";
+        std::set<Item *> prevSpillReplace;
+
+        for (int32_t i = 0; ; i++) {
+            FunctionLivenessAnalyzer live_analyzer(this->F);
+            live_analyzer.calculate_GENKILL();
+            live_analyzer.calculate_INOUT();
+
+            std::unordered_map<Item *, Color> item2color;
+            std::set<Item *> NonColorItems;
+
+            LinearScanSelector scan_selector(
+                this->F,
+                &live_analyzer,
+                &prevSpillReplace
+            );
+            bool AllAssigned = scan_selector.assignColorForAll(
+                item2color,
+                NonColorItems
+            );
+
+            this->color_variables(this->F, item2color);
+            this->remove_self_moves(this->F);
+
+            if (AllAssigned) break;
+
+            std::vector<Item *> varsToSpill;
+            for (Item * var : NonColorItems) {
+                if (IN_SET(prevSpillReplace, var)) {
+                    /**
+                     *  a spill temporary found no register, let graph coloring do it
+                     * */
+                    DEBUG_OUT << "linear scan gives up on " << this->F->name << '\n';
+                    this->F = F_copy;
+                    *this->F_addr = F_copy;
+                    this->allcoate();
+                    return;
+                }
+                varsToSpill.push_back(var);
+            }
+
+            for (uint32_t j = 0 ; j < varsToSpill.size(); j++) {
+                std::string prefix_str =    SpillPrefixPre 
+                                        +   std::to_string(i) + "_"
+                                        +   std::to_string(j) + "_";
+
+                ItemVariable * prefix = new ItemVariable(
+                    prefix_str
+                );
+
+                SpillMode mode = spill_everywhere;
+                if (rematerializable_value(this->F, (ItemVariable *) varsToSpill[j]) != NULL) {
+                    mode = spill_rematerialize;
+                }
+
+                Spiller sp (
+                    this->F,
+                    (ItemVariable *) varsToSpill[j],
+                    prefix,
+                    mode
+                );
+
+                sp.spill_variables();
+
+                std::vector<ItemVariable *> var_replacements = sp.get_var_replacement();
+                prevSpillReplace.insert(
+                    var_replacements.begin(),
+                    var_replacements.end()
+                );
+            }
+        }
+
+        SpillSlotColorer slot_colorer(this->F, firstSpillSlot);
+        slot_colorer.share_slots();
+    }
+
     void RegisterAllocator::color_variables(
         Function * F,
         std::unordered_map<Item *, Color> & item2color
@@ -644,77 +925,421 @@ namespace L2 {
     
 
 
+    void RegisterAllocator::remove_self_moves(Function * F) {
+        /**
+         *  copies whose ends got the same register do nothing
+         * */
+        std::vector<Instruction *> kept;
+        for (Instruction * inst : F->instructions) {
+            if (inst->type == InstType::inst_assign) {
+                Instruction_assignment * assign = (Instruction_assignment *) inst;
+                if (assign->dst == assign->src && assign->dst->itemtype == ItemType::item_registers) {
+                    continue;
+                }
+            }
+            kept.push_back(inst);
+        }
+
+        F->instructions = kept;
+    }
+
+
     NodeSelector::NodeSelector(
-                InterferenceGraph & intGraph, 
+                InterferenceGraph * intGraph, 
+                Function * F,
+                std::vector<double> * spillCost,
                 int32_t color_num
     ) {
         this->intGraph = intGraph;
+        this->spillCost = spillCost;
         this->color_num = color_num;
+
+        int32_t node_num = intGraph->node_num();
+        this->degree.resize(node_num);
+        this->state.resize(node_num);
+        this->alias.resize(node_num);
+        this->moveList.assign(node_num, std::vector<int32_t>());
+        this->mark.assign(node_num, 0);
+        this->markStamp = 0;
+
+        for (int32_t v = 0; v < node_num; v++) {
+            this->alias[v] = v;
+
+            if (intGraph->get_node(v)->itemtype == ItemType::item_registers) {
+                /**
+                 *  registers never leave the graph, treat them as always significant
+                 * */
+                this->state[v] = node_precolored;
+                this->degree[v] = INT32_MAX / 2;
+            } else {
+                /**
+                 *  the real worklist is chosen by make_worklists
+                 * */
+                this->state[v] = node_simplify;
+                this->degree[v] = intGraph->get_degree(v);
+            }
+        }
+
+        this->collect_moves(F);
+        this->make_worklists();
     }
 
-    void NodeSelector::populate_stack(std::stack<Item *> & nodeStack) {
-        while (Item * it = this->select_next_node())
-        {   
-            if(it->itemtype == ItemType::item_variable) {
-                DEBUG_OUT << "push on stack " << it->to_string() << '\n';
-                nodeStack.push(it);
+    void NodeSelector::collect_moves(Function * F) {
+        for (Instruction * inst : F->instructions) {
+            if (inst->type != InstType::inst_assign) continue;
+
+            Instruction_assignment * assign = (Instruction_assignment *) inst;
+            int32_t dst = this->intGraph->get_index(assign->dst);
+            int32_t src = this->intGraph->get_index(assign->src);
+
+            /**
+             *  only copies between two variables/registers, not both registers
+             * */
+            if (dst < 0 || src < 0 || dst == src) continue;
+            if (this->is_precolored(dst) && this->is_precolored(src)) continue;
+
+            int32_t m = this->moves.size();
+            this->moves.push_back({dst, src, move_worklist});
+            this->moveList[dst].push_back(m);
+            this->moveList[src].push_back(m);
+            this->worklistMoves.push_back(m);
+        }
+    }
+
+    void NodeSelector::make_worklists() {
+        for (int32_t v = 0; v < this->intGraph->node_num(); v++) {
+            if (this->is_precolored(v)) continue;
+
+            if (this->degree[v] >= this->color_num) {
+                this->push_worklist(v, node_spill);
+            } else if (this->move_related(v)) {
+                this->push_worklist(v, node_freeze);
+            } else {
+                this->push_worklist(v, node_simplify);
             }
-            
         }
-        
     }
 
-    Item * NodeSelector::select_next_node() {
+    void NodeSelector::push_worklist(int32_t node, NodeState newState) {
+        this->state[node] = newState;
+
+        switch (newState)
+        {
+            case node_simplify:
+                this->simplifyWorklist.push_back(node);
+                break;
+            case node_freeze:
+                this->freezeWorklist.push_back(node);
+                break;
+            case node_spill:
+                this->spillWorklist.push_back(node);
+                break;
+            default:
+                break;
+        }
+    }
+
+    bool NodeSelector::pop_worklist(
+        std::vector<int32_t> & worklist,
+        NodeState listState,
+        int32_t & node
+    ) {
+        while (!worklist.empty()) {
+            node = worklist.back();
+            worklist.pop_back();
+
+            if (this->state[node] == listState) return true;
+        }
+
+        return false;
+    }
+
+    bool NodeSelector::is_precolored(int32_t node) {
+        return this->state[node] == node_precolored;
+    }
+
+    bool NodeSelector::move_related(int32_t node) {
+        for (int32_t m : this->moveList[node]) {
+            if (this->moves[m].state == move_active || this->moves[m].state == move_worklist) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int32_t NodeSelector::find_alias(int32_t node) {
+        while (this->state[node] == node_coalesced) {
+            node = this->alias[node];
+        }
+        return node;
+    }
+
+    void NodeSelector::enable_moves(int32_t node) {
+        for (int32_t m : this->moveList[node]) {
+            if (this->moves[m].state == move_active) {
+                this->moves[m].state = move_worklist;
+                this->worklistMoves.push_back(m);
+            }
+        }
+    }
+
+    void NodeSelector::decrement_degree(int32_t node) {
+        if (this->is_precolored(node)) return;
+
+        int32_t d = this->degree[node]--;
+        if (d != this->color_num) return;
 
         /**
-         *  edgeCnt2nodes contains the following information
-         *      (number_of_edges, set of nodes tha have such number_of_edges)
-         *   
-         *  Note that map keeps an increasing on number_of_edges
+         *  node just became insignificant, moves around it may coalesce now
          * */
-        std::map<int32_t, std::set<Item * >> edgeCnt2nodes;
-        this->intGraph.get_nodes_stats(edgeCnt2nodes);
-        
-        // DEBUG_OUT << "edgeCnt2nodes.size() = " << edgeCnt2nodes.size() << '\n';
-        Item * toRemove = NULL;
-        if (edgeCnt2nodes.size() == 0) return NULL;
+        this->enable_moves(node);
+        for (int32_t n : this->intGraph->get_neighbors(node)) {
+            if (this->state[n] == node_selected || this->state[n] == node_coalesced) continue;
+            this->enable_moves(n);
+        }
 
-        int32_t lowest_num_edges = edgeCnt2nodes.begin()->first;
+        if (this->state[node] == node_spill) {
+            this->push_worklist(node, this->move_related(node) ? node_freeze : node_simplify);
+        }
+    }
 
-        if (lowest_num_edges <= this->color_num) {
-            /**
-             *  toRemove = the one with most number of edges <= this->color_num
-             * */
-            for (auto & kv : edgeCnt2nodes) {
-                int32_t number_of_edges = kv.first;
-            
-                if (number_of_edges > this->color_num) {
+    void NodeSelector::add_edge(int32_t u, int32_t v) {
+        if (!this->intGraph->add_edge(u, v)) return;
+
+        if (!this->is_precolored(u)) this->degree[u]++;
+        if (!this->is_precolored(v)) this->degree[v]++;
+    }
+
+    void NodeSelector::add_worklist(int32_t node) {
+        if (   this->state[node] == node_freeze
+            && !this->move_related(node)
+            && this->degree[node] < this->color_num) {
+            this->push_worklist(node, node_simplify);
+        }
+    }
+
+    bool NodeSelector::george_ok(int32_t t, int32_t u) {
+        return     this->degree[t] < this->color_num
+                || this->is_precolored(t)
+                || this->intGraph->has_edge(t, u);
+    }
+
+    bool NodeSelector::briggs_conservative(int32_t u, int32_t v) {
+        this->markStamp++;
+        int32_t k = 0;
+
+        for (int32_t node : {u, v}) {
+            for (int32_t n : this->intGraph->get_neighbors(node)) {
+                if (this->state[n] == node_selected || this->state[n] == node_coalesced) continue;
+                if (this->mark[n] == this->markStamp) continue;
+
+                this->mark[n] = this->markStamp;
+                if (this->degree[n] >= this->color_num) k++;
+            }
+        }
+
+        return k < this->color_num;
+    }
+
+    void NodeSelector::combine(int32_t u, int32_t v) {
+        this->state[v] = node_coalesced;
+        this->alias[v] = u;
+        (*this->spillCost)[u] += (*this->spillCost)[v];
+        this->coalescedNodes.push_back(this->intGraph->get_node(v));
+
+        this->moveList[u].insert(
+            this->moveList[u].end(),
+            this->moveList[v].begin(),
+            this->moveList[v].end()
+        );
+        this->enable_moves(v);
+
+        for (int32_t t : this->intGraph->get_neighbors(v)) {
+            if (this->state[t] == node_selected || this->state[t] == node_coalesced) continue;
+
+            this->add_edge(t, u);
+            this->decrement_degree(t);
+        }
+
+        if (this->degree[u] >= this->color_num && this->state[u] == node_freeze) {
+            this->push_worklist(u, node_spill);
+        }
+    }
+
+    void NodeSelector::freeze_moves(int32_t node) {
+        int32_t u = this->find_alias(node);
+
+        for (int32_t m : this->moveList[node]) {
+            if (this->moves[m].state != move_active && this->moves[m].state != move_worklist) continue;
+
+            int32_t x = this->find_alias(this->moves[m].dst);
+            int32_t y = this->find_alias(this->moves[m].src);
+            int32_t v = (y == u) ? x : y;
+
+            this->moves[m].state = move_frozen;
+
+            if (   this->state[v] == node_freeze
+                && !this->move_related(v)
+                && this->degree[v] < this->color_num) {
+                this->push_worklist(v, node_simplify);
+            }
+        }
+    }
+
+    void NodeSelector::simplify(int32_t node) {
+        this->state[node] = node_selected;
+        this->selectStack.push_back(node);
+
+        for (int32_t n : this->intGraph->get_neighbors(node)) {
+            if (this->state[n] == node_selected || this->state[n] == node_coalesced) continue;
+            this->decrement_degree(n);
+        }
+    }
+
+    void NodeSelector::coalesce(int32_t move) {
+        int32_t x = this->find_alias(this->moves[move].dst);
+        int32_t y = this->find_alias(this->moves[move].src);
+
+        /**
+         *  a register can only be u
+         * */
+        int32_t u = x, v = y;
+        if (this->is_precolored(y)) {
+            u = y;
+            v = x;
+        }
+
+        if (u == v) {
+            this->moves[move].state = move_coalesced;
+            this->add_worklist(u);
+            return;
+        }
+
+        if (this->is_precolored(v) || this->intGraph->has_edge(u, v)) {
+            this->moves[move].state = move_constrained;
+            this->add_worklist(u);
+            this->add_worklist(v);
+            return;
+        }
+
+        bool canCombine;
+        if (this->is_precolored(u)) {
+            canCombine = true;
+            for (int32_t t : this->intGraph->get_neighbors(v)) {
+                if (this->state[t] == node_selected || this->state[t] == node_coalesced) continue;
+                if (!this->george_ok(t, u)) {
+                    canCombine = false;
                     break;
                 }
-
-                toRemove = *kv.second.begin();
             }
+        } else {
+            canCombine = this->briggs_conservative(u, v);
+        }
 
+        if (canCombine) {
+            this->moves[move].state = move_coalesced;
+            this->combine(u, v);
+            this->add_worklist(u);
         } else {
-            /**
-             *  toRemove = the one with most number of edges 
-             * */
-            toRemove = *(edgeCnt2nodes.rbegin()->second.begin());
+            this->moves[move].state = move_active;
+        }
+    }
+
+    void NodeSelector::freeze(int32_t node) {
+        this->push_worklist(node, node_simplify);
+        this->freeze_moves(node);
+    }
+
+    bool NodeSelector::select_spill() {
+        /**
+         *  drop the stale entries while looking for the cheapest node per edge
+         *      a coalesced node costs as much as everything merged into it
+         * */
+        int32_t toSpill = -1;
+        double toSpillCost = 0;
+        int32_t kept = 0;
+        for (int32_t v : this->spillWorklist) {
+            if (this->state[v] != node_spill) continue;
+
+            this->spillWorklist[kept++] = v;
+            double cost = (*this->spillCost)[v] / this->degree[v];
+            if (toSpill < 0 || cost < toSpillCost) {
+                toSpill = v;
+                toSpillCost = cost;
+            }
+        }
+        this->spillWorklist.resize(kept);
+
+        if (toSpill < 0) return false;
+
+        this->push_worklist(toSpill, node_simplify);
+        this->freeze_moves(toSpill);
+        return true;
+    }
+
+    void NodeSelector::populate_stack(std::stack<Item *> & nodeStack) {
+        while (true) {
+            int32_t node;
+
+            if (this->pop_worklist(this->simplifyWorklist, node_simplify, node)) {
+                this->simplify(node);
+            } else if (!this->worklistMoves.empty()) {
+                int32_t m = this->worklistMoves.back();
+                this->worklistMoves.pop_back();
+
+                if (this->moves[m].state == move_worklist) {
+                    this->coalesce(m);
+                }
+            } else if (this->pop_worklist(this->freezeWorklist, node_freeze, node)) {
+                this->freeze(node);
+            } else if (!this->select_spill()) {
+                break;
+            }
+        }
+
+        for (int32_t node : this->selectStack) {
+            Item * it = this->intGraph->get_node(node);
+            DEBUG_OUT << "push on stack " << it->to_string() << '\n';
+            nodeStack.push(it);
         }
+    }
 
-        this->intGraph.remove_node(toRemove);
+    Item * NodeSelector::get_alias(Item * node) {
+        int32_t idx = this->intGraph->get_index(node);
+        if (idx < 0) return node;
 
-        return toRemove;
-   
+        return this->intGraph->get_node(this->find_alias(idx));
+    }
+
+    std::vector<Item *> & NodeSelector::get_coalesced_nodes() {
+        return this->coalescedNodes;
+    }
+
+    void NodeSelector::get_move_partners(Item * node, std::vector<Item *> & partners) {
+        int32_t idx = this->intGraph->get_index(node);
+        if (idx < 0) return;
+
+        int32_t u = this->find_alias(idx);
+        for (int32_t m : this->moveList[u]) {
+            int32_t x = this->find_alias(this->moves[m].dst);
+            int32_t y = this->find_alias(this->moves[m].src);
+            int32_t v = (y == u) ? x : y;
+
+            if (v != u) {
+                partners.push_back(this->intGraph->get_node(v));
+            }
+        }
     }
 
 
     ColorSelector::ColorSelector (
         InterferenceGraph * intGraph, 
-        std::stack<Item *> *nodeStack
+        std::stack<Item *> *nodeStack,
+        NodeSelector * nodeSelector
     ) {
         this->intGraph = intGraph;
         this->nodeStack = nodeStack;
+        this->nodeSelector = nodeSelector;
     }
 
     /**
@@ -760,6 +1385,19 @@ namespace L2 {
             }
         }
 
+        /**
+         *  coalesced variables share the color of the node they were merged into
+         * */
+        for (Item * var : this->nodeSelector->get_coalesced_nodes()) {
+            auto it = item2color.find(this->nodeSelector->get_alias(var));
+            if (it != item2color.end()) {
+                item2color[var] = it->second;
+            } else {
+                NonColorItems.insert(var);
+                DEBUG_OUT << "Cannnot color " << var->to_string() << '\n';
+            }
+        }
+
         return NonColorItems.size() == 0;        
     }
 
@@ -776,12 +1414,26 @@ namespace L2 {
          *  • Sort the colors at design time starting from caller save registers
          *  • Use the lowest free color
          */
-        std::set<Item *> neighbors = this->intGraph->get_neighbors(toColor);
-        std::set<Color> neighbor_colors;
+        bool neighbor_colors[L2::COLOR_NUM] = { false };
 
-        for (Item * n : neighbors) {
-            if (IN_MAP(item2color, n)) {
-                neighbor_colors.insert(item2color[n]);
+        for (int32_t n : this->intGraph->get_neighbors(this->intGraph->get_index(toColor))) {
+            auto it = item2color.find(this->nodeSelector->get_alias(this->intGraph->get_node(n)));
+            if (it != item2color.end()) {
+                neighbor_colors[it->second] = true;
+            }
+        }
+
+        /**
+         *  prefer the color of a node it is copied from/to (arguments, return value, ...)
+         *      so that copy turns into a self move
+         * */
+        std::vector<Item *> partners;
+        this->nodeSelector->get_move_partners(toColor, partners);
+        for (Item * partner : partners) {
+            auto it = item2color.find(partner);
+            if (it != item2color.end() && !neighbor_colors[it->second]) {
+                item2color[toColor] = it->second;
+                return true;
             }
         }
 
@@ -789,7 +1441,7 @@ namespace L2 {
         for (uint32_t i = 0; i < L2::COLOR_NUM; i++) {
             Color c = sorted_color[i];
             
-            if (!IN_SET(neighbor_colors, c)) {
+            if (!neighbor_colors[c]) {
                 item2color[toColor] = c;
                 return true;
             }
@@ -798,16 +1450,165 @@ namespace L2 {
         return false;
     }
 
+    SpillSlotColorer::SpillSlotColorer(Function * F, int64_t firstSlot) {
+        this->F = F;
+        this->firstSlot = firstSlot;
+        this->slotNum = F->locals - firstSlot;
+    }
+
+    int32_t SpillSlotColorer::slot_of(Item * item) {
+        if (item->itemtype != ItemType::item_memory) return -1;
+
+        ItemMemoryAccess * access = (ItemMemoryAccess *) item;
+        if (access->reg != &L2::reg_rsp || access->offset->itemtype != ItemType::item_constant) return -1;
+
+        int64_t offset = ((ItemConstant *) access->offset)->constVal;
+        if (offset % 8 != 0) return -1;
+
+        int64_t slot = offset / 8 - this->firstSlot;
+        if (slot < 0 || slot >= this->slotNum) return -1;
+
+        return slot;
+    }
+
+    void SpillSlotColorer::share_slots() {
+        if (this->slotNum <= 1) return;
+
+        std::vector<Instruction *> & insts = this->F->instructions;
+        int32_t instNum = insts.size();
+
+        /**
+         *  spill code only moves a whole slot from/to a variable
+         *      load:  %S <- mem rsp k   (GEN)
+         *      store: mem rsp k <- %S   (KILL)
+         * */
+        std::vector<int32_t> loadSlot(instNum, -1);
+        std::vector<int32_t> storeSlot(instNum, -1);
+        std::unordered_map<Instruction *, int32_t> inst2idx;
+        for (int32_t i = 0; i < instNum; i++) {
+            inst2idx[insts[i]] = i;
+            if (insts[i]->type != InstType::inst_assign) continue;
+
+            Instruction_assignment * assign = (Instruction_assignment *) insts[i];
+            loadSlot[i] = this->slot_of(assign->src);
+            storeSlot[i] = this->slot_of(assign->dst);
+        }
+
+        SuccessorVisitor succVisitor;
+        succVisitor.find_successors(this->F);
+
+        std::vector<std::vector<int32_t>> succs(instNum);
+        std::vector<std::vector<int32_t>> preds(instNum);
+        for (int32_t i = 0; i < instNum; i++) {
+            for (Instruction * succ : succVisitor.successor[insts[i]]) {
+                if (succ == NULL) continue;
+                succs[i].push_back(inst2idx[succ]);
+                preds[inst2idx[succ]].push_back(i);
+            }
+        }
+
+        /**
+         *  backward liveness of the slots over the instructions
+         * */
+        std::vector<BitVector> IN(instNum, BitVector(this->slotNum));
+        std::vector<BitVector> OUT(instNum, BitVector(this->slotNum));
+        std::vector<int32_t> worklist;
+        std::vector<bool> inWorklist(instNum, true);
+        for (int32_t i = 0; i < instNum; i++) {
+            worklist.push_back(i);
+        }
+
+        while (!worklist.empty()) {
+            int32_t i = worklist.back();
+            worklist.pop_back();
+            inWorklist[i] = false;
+
+            for (int32_t succ : succs[i]) {
+                OUT[i].union_with(IN[succ]);
+            }
+
+            BitVector in = OUT[i];
+            if (storeSlot[i] >= 0) in.reset(storeSlot[i]);
+            if (loadSlot[i] >= 0) in.set(loadSlot[i]);
+            if (in == IN[i]) continue;
+
+            IN[i] = in;
+            for (int32_t pred : preds[i]) {
+                if (!inWorklist[pred]) {
+                    inWorklist[pred] = true;
+                    worklist.push_back(pred);
+                }
+            }
+        }
+
+        /**
+         *  a store interferes with every other slot live after it
+         * */
+        std::vector<BitVector> conflicts(this->slotNum, BitVector(this->slotNum));
+        std::vector<int32_t> live;
+        for (int32_t i = 0; i < instNum; i++) {
+            int32_t s = storeSlot[i];
+            if (s < 0) continue;
+
+            live.clear();
+            OUT[i].to_indices(live);
+            for (int32_t t : live) {
+                if (t == s) continue;
+                conflicts[s].set(t);
+                conflicts[t].set(s);
+            }
+        }
+
+        /**
+         *  greedy coloring in slot order
+         * */
+        std::vector<int32_t> slot2color(this->slotNum);
+        int32_t colorNum = 0;
+        std::vector<int32_t> neighbors;
+        std::vector<bool> used;
+        for (int32_t s = 0; s < this->slotNum; s++) {
+            used.assign(colorNum + 1, false);
+
+            neighbors.clear();
+            conflicts[s].to_indices(neighbors);
+            for (int32_t t : neighbors) {
+                if (t < s) used[slot2color[t]] = true;
+            }
+
+            int32_t c = 0;
+            while (used[c]) c++;
+            slot2color[s] = c;
+            colorNum = MAX(colorNum, c + 1);
+        }
+
+        for (int32_t i = 0; i < instNum; i++) {
+            if (loadSlot[i] < 0 && storeSlot[i] < 0) continue;
+
+            Instruction_assignment * assign = (Instruction_assignment *) insts[i];
+            ItemMemoryAccess * access = (ItemMemoryAccess *) ((loadSlot[i] >= 0) ? assign->src : assign->dst);
+            int32_t s = (loadSlot[i] >= 0) ? loadSlot[i] : storeSlot[i];
+
+            access->offset = new ItemConstant((this->firstSlot + slot2color[s]) * 8);
+        }
+
+        DEBUG_OUT << this->F->name << ": " << this->slotNum << " spill slots in " << colorNum << '\n';
+        this->F->locals = this->firstSlot + colorNum;
+    }
+
     SpillVarSelector::SpillVarSelector(
         std::set<Item *> * NonColorItems,
-        std::set<Item *> * prevSpillReplace
+        std::set<Item *> * prevSpillReplace,
+        InterferenceGraph * intGraph,
+        std::vector<double> * spillCost
     ) {
         this->NonColorItems = NonColorItems;
         this->prevSpillReplace = prevSpillReplace;
+        this->intGraph = intGraph;
+        this->spillCost = spillCost;
     }
 
     /**
-     *  spill all right now
+     *  spill the uncolored variables, or what blocks the uncolored spill variables
      * */
     void SpillVarSelector::selectVarsToSpill(std::vector<Item *> &varsToSpill){
         std::set<Item*> target;
@@ -818,6 +1619,29 @@ namespace L2 {
         );
 
 
+        if (target.empty()) {
+            /**
+             *  a variable created by spilling cannot be spilled again,
+             *      free a register for it by spilling its cheapest neighbor
+             * */
+            for (Item * var : *this->NonColorItems) {
+                int32_t toSpill = -1;
+                for (int32_t n : this->intGraph->get_neighbors(this->intGraph->get_index(var))) {
+                    Item * neighbor = this->intGraph->get_node(n);
+                    if (neighbor->itemtype != ItemType::item_variable) continue;
+                    if (IN_SET((*this->prevSpillReplace), neighbor)) continue;
+
+                    if (toSpill < 0 || (*this->spillCost)[n] < (*this->spillCost)[toSpill]) {
+                        toSpill = n;
+                    }
+                }
+
+                if (toSpill >= 0) {
+                    target.insert(this->intGraph->get_node(toSpill));
+                }
+            }
+        }
+
         varsToSpill.insert(
             varsToSpill.end(),              /* position to insert*/
             target.begin(),                 /* first iterator */
@@ -825,12 +1649,16 @@ namespace L2 {
         );
     }
 
-    void run_register_allocation(Program &p) {
+    void run_register_allocation(Program &p, SpillMode spillMode, int64_t linearScanThreshold) {
         for (int32_t i = 0; i < p.functions.size(); i++) {
-            RegisterAllocator reg_alloc(p.functions[i], &p.functions[i]);
+            RegisterAllocator reg_alloc(p.functions[i], &p.functions[i], spillMode);
 
             DEBUG_OUT << "Begin allocation for " << p.functions[i]->name << '\n';
-            reg_alloc.allcoate();
+            if (linearScanThreshold >= 0 && p.functions[i]->instructions.size() >= linearScanThreshold) {
+                reg_alloc.linear_scan();
+            } else {
+                reg_alloc.allcoate();
+            }
 
             p.functions[i]->print();
         }
@@ -6,10 +6,20 @@
 #include "spiller.h"
 
 namespace L2 {
-    void run_register_allocation(Program &p);
+    /**
+     *  functions with at least @linearScanThreshold instructions are allocated
+     *      with linear scan instead of graph coloring, -1 never does
+     * */
+    void run_register_allocation(Program &p, SpillMode spillMode, int64_t linearScanThreshold);
 
     const int32_t COLOR_NUM = 15;
 
+    /**
+     *  spill cost of registers and of variables created by spilling
+     *      still ordered by degree when divided by it
+     * */
+    const double UNSPILLABLE_COST = 1e30;
+
     enum Color {
         rdi_color, 
         rsi_color, 
@@ -37,32 +47,119 @@ namespace L2 {
         public:
         /**
          *  Constructor of node selector
-         *      will copy intGraph to its own member
-         *      so pass by reference but no change to intGraph
+         *      simplify, coalesce, freeze and potential spill run on intGraph in place:
+         *      coalescing a node moves its edges to the node it is merged into
+         *      the copies between two nodes of intGraph in F are the coalescing candidates
+         *      spillCost[v] is the estimated cost of spilling node v
          * */
             NodeSelector(
-                InterferenceGraph & intGraph, 
+                InterferenceGraph * intGraph, 
+                Function * F,
+                std::vector<double> * spillCost,
                 int32_t color_num
             );
 
             void populate_stack(std::stack<Item *> & nodeStack);
+
+            /**
+             *  the node @node was coalesced into, @node itself if it was not coalesced
+             * */
+            Item * get_alias(Item * node);
+
+            /**
+             *  variables coalesced into another node, they take the color of their alias
+             * */
+            std::vector<Item *> & get_coalesced_nodes();
+
+            /**
+             *  aliases of the nodes @node is copied from/to
+             *      coloring prefers their colors so the copies disappear
+             * */
+            void get_move_partners(Item * node, std::vector<Item *> & partners);
                     
         private:
+            enum NodeState {
+                node_precolored,
+                node_simplify,
+                node_freeze,
+                node_spill,
+                node_coalesced,
+                node_selected
+            };
+
+            enum MoveState {
+                move_worklist,
+                move_active,
+                move_coalesced,
+                move_constrained,
+                move_frozen
+            };
+
+            struct Move {
+                int32_t dst;
+                int32_t src;
+                MoveState state;
+            };
+
+            InterferenceGraph * intGraph;
+            std::vector<double> * spillCost;
+            int32_t color_num;
 
             /**
-             *  local copy of interference graph
+             *  the worklists are lazy: a node/move is pushed whenever it enters a list
+             *      and entries whose state no longer matches are skipped when popped
              * */
-            InterferenceGraph intGraph;
-            int32_t color_num;
+            std::vector<int32_t> degree;
+            std::vector<NodeState> state;
+            std::vector<int32_t> alias;
+            std::vector<std::vector<int32_t>> moveList;
+            std::vector<Move> moves;
+
+            std::vector<int32_t> simplifyWorklist;
+            std::vector<int32_t> freezeWorklist;
+            std::vector<int32_t> spillWorklist;
+            std::vector<int32_t> worklistMoves;
+            std::vector<int32_t> selectStack;
+            std::vector<Item *> coalescedNodes;
+
+            /**
+             *  stamps to count the union of two neighborhoods without a set
+             * */
+            std::vector<int32_t> mark;
+            int32_t markStamp;
+
+            void collect_moves(Function * F);
+            void make_worklists();
+            void push_worklist(int32_t node, NodeState newState);
+            bool pop_worklist(std::vector<int32_t> & worklist, NodeState listState, int32_t & node);
+
+            bool is_precolored(int32_t node);
+            bool move_related(int32_t node);
+            int32_t find_alias(int32_t node);
+            void enable_moves(int32_t node);
+            void decrement_degree(int32_t node);
+            void add_edge(int32_t u, int32_t v);
+            void add_worklist(int32_t node);
 
             /**
-             *  • Remove the node with the most edges
-                  that’s smaller than then number of colors (15 in L1)
-                • After all nodes with <= 15 edges are removed,
-                  remove the remaining ones starting from the one
-                  with the highest number of edges
+             *  George: every neighbor t of v already interferes with the register u
+             *      or is insignificant
+             *  Briggs: u and v together have fewer than color_num significant neighbors
              * */
-            Item * select_next_node();    
+            bool george_ok(int32_t t, int32_t u);
+            bool briggs_conservative(int32_t u, int32_t v);
+            void combine(int32_t u, int32_t v);
+            void freeze_moves(int32_t node);
+
+            void simplify(int32_t node);
+            void coalesce(int32_t move);
+            void freeze(int32_t node);
+
+            /**
+             *  potential spill: the remaining node with the lowest spill cost per edge
+             *      false once there is nothing left
+             * */
+            bool select_spill();
     };
 
 
@@ -74,7 +171,8 @@ namespace L2 {
              * */
             ColorSelector(
                 InterferenceGraph * intGraph, 
-                std::stack<Item *> *nodeStack
+                std::stack<Item *> *nodeStack,
+                NodeSelector * nodeSelector
             );
             /**
              *  Try to assign colors for all variables
@@ -90,6 +188,7 @@ namespace L2 {
         private:
             std::stack<Item *> * nodeStack;
             InterferenceGraph * intGraph;
+            NodeSelector * nodeSelector;
             // std::unordered_map<Item *, Color> item2color;
             
 
@@ -127,20 +226,54 @@ namespace L2 {
         public:
             SpillVarSelector(
                 std::set<Item *> * NonColorItems,
-                std::set<Item *> * prevSpillReplace
+                std::set<Item *> * prevSpillReplace,
+                InterferenceGraph * intGraph,
+                std::vector<double> * spillCost
             );
 
             /**
-             *  spill all right now
+             *  spill the variables that could not be colored
              *      except those created by previous spills
+             *  if only those are left, spill the cheapest variable
+             *      interfering with each of them instead
              * */
             void selectVarsToSpill(std::vector<Item *> &varsToSpill);
 
         private:
             std::set<Item *> * NonColorItems;
             std::set<Item *> * prevSpillReplace;
+            InterferenceGraph * intGraph;
+            std::vector<double> * spillCost;
     };  
 
+    /**
+     *  Stack slots created by spilling are colored like registers:
+     *      two slots interfere if one is stored while the other is live,
+     *      slots that never interfere share the same stack location
+     * */
+    class SpillSlotColorer {
+        public:
+            /**
+             *  slots [firstSlot, F->locals) are the ones created by spilling
+             * */
+            SpillSlotColorer(Function * F, int64_t firstSlot);
+
+            /**
+             *  rewrite the slot offsets and shrink F->locals
+             * */
+            void share_slots();
+
+        private:
+            Function * F;
+            int64_t firstSlot;
+            int32_t slotNum;
+
+            /**
+             *  slot of a spill load/store, -1 if @item is not a spill slot
+             * */
+            int32_t slot_of(Item * item);
+    };
+
     class VarColorVisitor : public InstVisitor
     {
     public:
@@ -175,17 +308,82 @@ namespace L2 {
 
     class RegisterAllocator {
         public:
-            RegisterAllocator(Function * F, Function ** F_addr);
+            /**
+             *  @spillMode is how variables are spilled the first time
+             *      temporaries created by spill_split_blocks are spilled everywhere
+             *      if they have to be spilled again
+             * */
+            RegisterAllocator(Function * F, Function ** F_addr, SpillMode spillMode);
 
             void allcoate();
 
+            /**
+             *  linear scan rounds instead of graph coloring
+             *      falls back to allcoate() if a variable created by spilling
+             *      cannot get a register
+             * */
+            void linear_scan();
+
         private:
             Function * F;
             Function ** F_addr;
+            SpillMode spillMode;
             // VarColorVisitor * var_color_visitor;
             
             void color_variables(Function * F, std::unordered_map<Item *, Color> & item2color);
-            bool analysisAndColoring(Function * , std::set<Item *> & NonColorItems);
+            void remove_self_moves(Function * F);
+
+            /**
+             *  spill cost of every node of intGraph:
+             *      uses and defs weighted by 10^(loop depth)
+             * */
+            void compute_spill_costs(
+                FunctionLivenessAnalyzer & live_analyzer,
+                InterferenceGraph & intGraph,
+                std::set<Item *> & prevSpillReplace,
+                std::vector<double> & spillCost
+            );
+
+            /**
+             *  spill cost of the nodes a spill added to intGraph
+             *      only the variables in @spillableVars can be spilled again,
+             *      they are weighted over @changedSlots, where all their uses are
+             * */
+            void update_spill_costs(
+                FunctionLivenessAnalyzer & live_analyzer,
+                InterferenceGraph & intGraph,
+                std::vector<int32_t> & changedSlots,
+                std::vector<ItemVariable *> & spillableVars,
+                std::vector<double> & spillCost
+            );
+
+            /**
+             *  color a copy of intGraph, so it can be patched for the next round
+             *      @item2color will contain mapping from variable to its color
+             *      @NonColorItems will contain the variables that cannot be colored
+             *      @varsToSpill will contain the variables to spill before the next round
+             * */
+            bool color_graph(
+                Function * F,
+                InterferenceGraph & intGraph,
+                std::vector<double> & spillCost,
+                std::set<Item *> & prevSpillReplace,
+                std::unordered_map<Item *, Color> & item2color,
+                std::set<Item *> & NonColorItems,
+                std::vector<Item *> & varsToSpill
+            );
+
+            /**
+             *  color F in place as far as possible
+             *      @NonColorItems will contain the variables that cannot be colored
+             *      @varsToSpill will contain the variables to spill before the next round
+             * */
+            bool analysisAndColoring(
+                Function * F,
+                std::set<Item *> & prevSpillReplace,
+                std::set<Item *> & NonColorItems,
+                std::vector<Item *> & varsToSpill
+            );
     };
 
 }
\ No newline at end of file
@@ -80,15 +80,68 @@ namespace L2 {
     }
 
 
+    Item * rematerializable_value(Function * F, ItemVariable * var) {
+        Item * value = NULL;
+
+        for (Instruction * inst : F->instructions) {
+            Item * dst = NULL;
+            Item * src = NULL;
+
+            switch (inst->type)
+            {
+                case InstType::inst_assign :
+                    dst = ((Instruction_assignment *) inst)->dst;
+                    src = ((Instruction_assignment *) inst)->src;
+                    break;
+                case InstType::inst_aop :
+                    dst = ((Instruction_aop *) inst)->op1;
+                    break;
+                case InstType::inst_sop :
+                    dst = ((Instruction_sop *) inst)->target;
+                    break;
+                case InstType::inst_lea :
+                    dst = ((Instruction_lea *) inst)->dst;
+                    break;
+                case InstType::inst_inc :
+                    dst = ((Instruction_inc *) inst)->op;
+                    break;
+                case InstType::inst_dec :
+                    dst = ((Instruction_dec *) inst)->op;
+                    break;
+                default:
+                    break;
+            }
+
+            if (dst != var) continue;
+
+            /**
+             *  every definition has to assign the same constant/label
+             * */
+            if (src == NULL) return NULL;
+            if (src->itemtype != ItemType::item_constant && src->itemtype != ItemType::item_labels) return NULL;
+            if (value != NULL && value->to_string() != src->to_string()) return NULL;
+
+            value = src;
+        }
+
+        return value;
+    }
+
+
     SpillerVisitor::SpillerVisitor(
         ItemVariable * varToSpill,
         ItemVariable * prefix,
-        Function * F
+        Function * F,
+        SpillMode mode
     ) {
         this->varToSpill = varToSpill;
         this->prefix = prefix;
         this->F = F;
         this->suffix_num = 0;
+        this->mode = mode;
+        this->blockVar = NULL;
+        this->blockDirty = false;
+        this->rematValue = (mode == spill_rematerialize) ? rematerializable_value(F, varToSpill) : NULL;
     }
 
     ItemVariable * SpillerVisitor::build_new_var_prefix_suffix() {
@@ -116,12 +169,27 @@ namespace L2 {
         return memA;
     }
 
+    void SpillerVisitor::push_touched(Instruction * inst) {
+        this->touched.push_back(this->new_insts.size());
+        this->new_insts.push_back(inst);
+    }
+
     void SpillerVisitor::spill_Inst(
             Instruction * inst,
             bool HasRead,
             bool HasWritten,
             std::vector<Item **> & placeToReplace 
     ){
+        if (this->mode == spill_split_blocks) {
+            this->split_Inst(inst, HasRead, HasWritten, placeToReplace, false);
+            return;
+        }
+
+        if (this->mode == spill_rematerialize) {
+            this->remat_Inst(inst, HasRead, HasWritten, placeToReplace);
+            return;
+        }
+
         ItemVariable * new_var = NULL;
         ItemMemoryAccess * stacklocal = NULL;
         
@@ -137,7 +205,7 @@ namespace L2 {
             fetchFromStack->dst = new_var;
             fetchFromStack->src = stacklocal;
 
-            this->new_insts.push_back(fetchFromStack);
+            this->push_touched(fetchFromStack);
         }
 
 
@@ -153,7 +221,11 @@ namespace L2 {
             *wAddr = new_var;
         }
 
-        this->new_insts.push_back(inst);
+        if (placeToReplace.empty()) {
+            this->new_insts.push_back(inst);
+        } else {
+            this->push_touched(inst);
+        }
 
 
         if (HasWritten) 
@@ -175,15 +247,116 @@ namespace L2 {
             writeToStack->dst = stacklocal;
             writeToStack->src = new_var;
 
-            this->new_insts.push_back(writeToStack);
+            this->push_touched(writeToStack);
+
+        }
+    }
+
+    void SpillerVisitor::split_Inst(
+            Instruction * inst,
+            bool HasRead,
+            bool HasWritten,
+            std::vector<Item **> & placeToReplace,
+            bool endsBlock
+    ){
+        if (!placeToReplace.empty()) {
+            if (this->blockVar == NULL) {
+                this->blockVar = this->build_new_var_prefix_suffix();
+
+                /**
+                 *  %S0 <- mem rsp 0
+                 *      only needed when the first use of the block reads
+                 * */
+                if (HasRead) {
+                    Instruction_assignment * fetchFromStack = new Instruction_assignment;
+                    fetchFromStack->type = inst_assign;
+                    fetchFromStack->dst = this->blockVar;
+                    fetchFromStack->src = this->build_stackAccess_locals();
+
+                    this->push_touched(fetchFromStack);
+                }
+            }
+
+            for (Item ** wAddr : placeToReplace) {
+                *wAddr = this->blockVar;
+            }
+
+            if (HasWritten) {
+                this->blockDirty = true;
+            }
+        }
 
+        if (endsBlock) {
+            this->end_block(true);
+        }
+
+        if (placeToReplace.empty()) {
+            this->new_insts.push_back(inst);
+        } else {
+            this->push_touched(inst);
         }
     }
 
+    void SpillerVisitor::remat_Inst(
+            Instruction * inst,
+            bool HasRead,
+            bool HasWritten,
+            std::vector<Item **> & placeToReplace
+    ){
+        /**
+         *  the only writes are the definitions %v <- value
+         * */
+        if (HasWritten) return;
+
+        if (!placeToReplace.empty()) {
+            ItemVariable * new_var = this->build_new_var_prefix_suffix();
+
+            /**
+             *  %S0 <- value
+             * */
+            Instruction_assignment * recompute = new Instruction_assignment;
+            recompute->type = inst_assign;
+            recompute->dst = new_var;
+            recompute->src = this->rematValue;
+
+            this->push_touched(recompute);
+
+            for (Item ** wAddr : placeToReplace) {
+                *wAddr = new_var;
+            }
+
+            this->push_touched(inst);
+            return;
+        }
+
+        this->new_insts.push_back(inst);
+    }
+
+    void SpillerVisitor::end_block(bool store) {
+        if (this->mode != spill_split_blocks) return;
+
+        if (store && this->blockDirty) {
+            /**
+             *  mem rsp 0 <- %S0
+             * */
+            Instruction_assignment * writeToStack = new Instruction_assignment;
+            writeToStack->type = inst_assign;
+            writeToStack->dst = this->build_stackAccess_locals();
+            writeToStack->src = this->blockVar;
+
+            this->push_touched(writeToStack);
+        }
+
+        this->blockVar = NULL;
+        this->blockDirty = false;
+    }
+
     void SpillerVisitor::visit(Instruction_ret *ret) {
         /**
          *  push original instruction
+         *      nothing has to reach the stack after returning
          * */
+        this->end_block(false);
 
         this->new_insts.push_back(ret);
     } 
@@ -191,7 +364,10 @@ namespace L2 {
     void SpillerVisitor::visit(Instruction_label * label_inst) {
         /**
          *  push original instruction
+         *      a label may be jumped to, so the block falling into it ends here
          * */
+        this->end_block(true);
+
         this->new_insts.push_back(label_inst);
     }
 
@@ -211,6 +387,21 @@ namespace L2 {
          */
         std::vector<Item **> placeToReplace;
         bool var_used = Has_Used_varToSpill(&user_call->callee, this->varToSpill, placeToReplace);
+
+        if (this->mode == spill_split_blocks) {
+            /**
+             *  the callee returns to the return label, not to the next instruction
+             *      so the store has to happen before the call
+             * */
+            this->split_Inst(
+                user_call,
+                var_used,
+                false,
+                placeToReplace,
+                true
+            );
+            return;
+        }
                 
         this->spill_Inst(
             user_call,
@@ -314,6 +505,7 @@ namespace L2 {
          /**
          *  push original instruction
          * */
+        this->end_block(true);
 
         this->new_insts.push_back(inst_goto);
     }
@@ -363,6 +555,17 @@ namespace L2 {
          */
         std::vector<Item **> placeToReplace;
         bool var_used = Has_Used_varToSpill(&cjump->condition, this->varToSpill, placeToReplace);
+
+        if (this->mode == spill_split_blocks) {
+            this->split_Inst(
+                cjump,
+                var_used,
+                false,
+                placeToReplace,
+                true
+            );
+            return;
+        }
                 
         this->spill_Inst(
             cjump,
@@ -375,16 +578,19 @@ namespace L2 {
     Spiller::Spiller(
             Function * F,
             ItemVariable * varToSpill,
-            ItemVariable * prefix
+            ItemVariable * prefix,
+            SpillMode mode
     ){
         this->F = F;
         this->varToSpill = varToSpill;
         this->prefix = prefix;
+        this->mode = mode;
 
         this->spill_visitor = new SpillerVisitor(
             varToSpill,
             prefix,
-            F
+            F,
+            mode
         );
     }
 
@@ -397,7 +603,12 @@ namespace L2 {
         }
 
 
-        this->F->locals += 1;
+        /**
+         *  a rematerialized variable needs no stack slot
+         * */
+        if (this->mode != spill_rematerialize) {
+            this->F->locals += 1;
+        }
         
         for (Instruction *inst : this->F->instructions) {
             inst->accept(*this->spill_visitor);
@@ -415,6 +626,10 @@ namespace L2 {
         return this->spill_visitor->var_replacements;
     }
 
+    std::vector<int32_t> & Spiller::get_touched() {
+        return this->spill_visitor->touched;
+    }
+
 
     void Spiller::output_spilled_function()
     {   
@@ -437,7 +652,8 @@ namespace L2 {
             Spiller sp(
                 f,
                 p.varToSpill,
-                p.prefix
+                p.prefix,
+                spill_everywhere
             );
             
             sp.spill_variables();
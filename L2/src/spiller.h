@@ -7,6 +7,31 @@ namespace L2
 {
     void run_Spill(Program &p);
 
+    enum SpillMode {
+        /**
+         *  load/store around every instruction using the variable
+         * */
+        spill_everywhere,
+
+        /**
+         *  one temporary per basic block, loaded before the first read of the block
+         *      and stored back at the end of the block if the block wrote it
+         * */
+        spill_split_blocks,
+
+        /**
+         *  no stack slot: every definition is %v <- constant/label,
+         *      so recompute that value right before each use
+         * */
+        spill_rematerialize
+    };
+
+    /**
+     *  the constant/label every definition of @var assigns
+     *      NULL if @var is defined any other way (or not at all)
+     * */
+    Item * rematerializable_value(Function * F, ItemVariable * var);
+
     class SpillerVisitor : public InstVisitor
     {
     public:
@@ -26,11 +51,17 @@ namespace L2
         SpillerVisitor(
             ItemVariable * varToSpill,
             ItemVariable * prefix,
-            Function * F
+            Function * F,
+            SpillMode mode
         );
 
         std::vector<Instruction *> new_insts;
         std::vector<ItemVariable *> var_replacements;
+
+        /**
+         *  positions in new_insts of the instructions inserted or rewritten
+         * */
+        std::vector<int32_t> touched;
     private:
         Function * F;
         
@@ -43,6 +74,20 @@ namespace L2
         ItemVariable *varToSpill;
         ItemVariable *prefix;
         int32_t suffix_num;
+        SpillMode mode;
+
+        /**
+         *  spill_split_blocks only:
+         *      temporary holding varToSpill in the current block, NULL before its first use
+         *      blockDirty is set once the block wrote it
+         * */
+        ItemVariable *blockVar;
+        bool blockDirty;
+
+        /**
+         *  spill_rematerialize only: value recomputed before each use
+         * */
+        Item *rematValue;
 
         /**
          *  produce pointer to variable from prefix and suffix number
@@ -58,12 +103,45 @@ namespace L2
          * */
         ItemMemoryAccess * build_stackAccess_locals();
 
+        /**
+         *  push @inst to new_insts and remember it was inserted or rewritten
+         * */
+        void push_touched(Instruction * inst);
+
         void spill_Inst(
             Instruction * inst,
             bool HasRead,
             bool HasWritten,
             std::vector<Item **> & placeToWrite 
         );
+
+        /**
+         *  spill_split_blocks version of spill_Inst
+         *      @endsBlock: inst jumps, the store goes right before it
+         * */
+        void split_Inst(
+            Instruction * inst,
+            bool HasRead,
+            bool HasWritten,
+            std::vector<Item **> & placeToWrite,
+            bool endsBlock
+        );
+
+        /**
+         *  spill_rematerialize version of spill_Inst
+         *      the definitions are dropped, uses get a fresh copy of the value
+         * */
+        void remat_Inst(
+            Instruction * inst,
+            bool HasRead,
+            bool HasWritten,
+            std::vector<Item **> & placeToWrite
+        );
+
+        /**
+         *  leave the current block, storing blockVar back if @store and the block wrote it
+         * */
+        void end_block(bool store);
     
     };
 
@@ -76,15 +154,18 @@ namespace L2
             Spiller(
                 Function * F,
                 ItemVariable * varToSpill,
-                ItemVariable * prefix
+                ItemVariable * prefix,
+                SpillMode mode
             );
 
             std::vector<ItemVariable *> get_var_replacement();
+            std::vector<int32_t> & get_touched();
         private:
             Function * F;
 
             ItemVariable * varToSpill;
             ItemVariable * prefix;
+            SpillMode mode;
 
             SpillerVisitor * spill_visitor;
             
@@ -20,11 +20,9 @@ namespace L3 {
 
     void generateCode(
         Program & p,
-        std::vector<std::vector<InstSelectForest * >> & codeGenerator
+        std::vector<std::vector<InstSelectForest * >> & codeGenerator,
+        std::ostream & out
     ) {
-        std::ofstream out =  std::ofstream();
-        out.open("prog.L2");
-        
         out << "(" << p.mainF->name->to_string() << "\n";
         
         for (int16_t i = 0; i < p.functions.size(); i++) {
@@ -72,8 +70,18 @@ namespace L3 {
 
         out << ")\n";
 
-        out.close();
+    }
 
+    void generateCode(
+        Program & p,
+        std::vector<std::vector<InstSelectForest * >> & codeGenerator
+    ) {
+        std::ofstream out =  std::ofstream();
+        out.open("prog.L2");
+
+        generateCode(p, codeGenerator, out);
+
+        out.close();
     }
 }
 
@@ -10,4 +10,5 @@
 namespace L3 {
 
     void generateCode(Program & p, std::vector<std::vector<InstSelectForest * >> & codeGenerator);
+    void generateCode(Program & p, std::vector<std::vector<InstSelectForest * >> & codeGenerator, std::ostream & out);
 }
\ No newline at end of file
@@ -990,6 +990,32 @@ namespace L3{
             }
         }
 
+        /**
+         *  if tree_use stores through varOverlap and tree_def defines it with a constant/label
+         *      DONOT merge, the address of a store must stay a variable
+         * */
+        if (!assign_oprt->children[1]->isOperator && tree_use->head->isOperator) {
+            Item * definition = ((InstSelectNodeOperand *) assign_oprt->children[1])->data;
+            InstSelectNodeOperator * use_oprt = (InstSelectNodeOperator *) tree_use->head;
+
+            if (
+                    definition->itemtype != ItemType::item_variable
+                &&  use_oprt->op == OperatorType::assign
+                &&  use_oprt->children[0]->isOperator
+            ) {
+                InstSelectNodeOperator * store_oprt = (InstSelectNodeOperator *) use_oprt->children[0];
+                InstSelectNode * addr = store_oprt->children[0];
+
+                if (
+                        store_oprt->op == OperatorType::store
+                    &&  !addr->isOperator
+                    &&  ((InstSelectNodeOperand *) addr)->data == varOverlap
+                ) {
+                    return false;
+                }
+            }
+        }
+
         /**
          * A. %V is dead after the instruction attached to T1 or  (only one inst associate with )
          * %V is only used by T1 
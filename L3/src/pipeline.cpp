@@ -0,0 +1,21 @@
+#include <vector>
+
+#include "pipeline.h"
+#include "parser.h"
+#include "transformer.h"
+#include "inst_selection.h"
+#include "code_generator.h"
+
+namespace L3 {
+
+    void compile_source(const std::string & source, const std::string & sourceName, std::ostream & out){
+        auto p = L3::parse_string(source, sourceName);
+
+        std::vector<std::vector<L3::InstSelectForest *>> codeGenerator;
+
+        L3::transform_label(p);
+        L3::select_insts(p, codeGenerator);
+        L3::generateCode(p, codeGenerator, out);
+    }
+
+}
@@ -11,7 +11,7 @@ namespace LA {
     /**
      *  arg0, arg1, arg2
      * */
-    void output_args_helper(std::ofstream & out, std::vector<Item *> & args) {
+    void output_args_helper(std::ostream & out, std::vector<Item *> & args) {
         for (int32_t i = 0; i < args.size(); i++) {
             if (i > 0) {
                 out << ", ";
@@ -25,12 +25,9 @@ namespace LA {
     }
 
     
-    void generateCode(Program & p) {
+    void generateCode(Program & p, std::ostream & out) {
         LA::isOutputIR = 1;
 
-        std::ofstream out =  std::ofstream();
-        out.open("prog.IR");
-        
         for (Function * F : p.functions) {
             out << "define ";
             out << F->retType->to_string();
@@ -51,5 +48,12 @@ namespace LA {
 
         LA::isOutputIR = 0;
     }
+
+    void generateCode(Program & p) {
+        std::ofstream out =  std::ofstream();
+        out.open("prog.IR");
+
+        generateCode(p, out);
+    }
 }
 
@@ -15,6 +15,7 @@
 namespace LA {
 
     void generateCode(Program & p);
+    void generateCode(Program & p, std::ostream & out);
 
 //     class InstL3GenVisitor : public InstVisitor {
 //         public:
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <string>
+
 #include "LA.h"
 #include "utils.h"
 
 namespace LA {
     Program parse_file (char *fileName);
+    Program parse_string (const std::string & source, const std::string & sourceName);
 }
\ No newline at end of file
@@ -0,0 +1,22 @@
+#include "pipeline.h"
+#include "parser.h"
+#include "code_generator.h"
+#include "encode.h"
+#include "new_label_var.h"
+#include "check_memAccess.h"
+#include "BasicBlock.h"
+
+namespace LA {
+
+    void compile_source(const std::string & source, const std::string & sourceName, std::ostream & out){
+        auto p = LA::parse_string(source, sourceName);
+
+        LA::new_var_label_init(p);
+
+        LA::encode_program(p);
+        LA::insertMemCheck(p);
+        LA::enforceBasicBlock(p);
+        LA::generateCode(p, out);
+    }
+
+}
@@ -184,7 +184,7 @@ namespace LB {
 
 
     InstLBGenVisitor::InstLBGenVisitor(
-        std::ofstream *out,
+        std::ostream *out,
         std::map<Instruction_while *, ItemLabel *> * condlb,
         std::map<Instruction *, Instruction_while *> * inst2loop
     ) {
@@ -198,7 +198,7 @@ namespace LB {
     /**
      *  arg0, arg1, arg2
      * */
-    void output_args_helper(std::ofstream & out, std::vector<Item *> & args) {
+    void output_args_helper(std::ostream & out, std::vector<Item *> & args) {
         for (int32_t i = 0; i < args.size(); i++) {
             if (i > 0) {
                 out << ", ";
@@ -212,12 +212,7 @@ namespace LB {
     }
 
     
-    void generateCode(Program & p) {
-
-        std::ofstream out =  std::ofstream();
-        out.open("prog.a");
-        
-        
+    void generateCode(Program & p, std::ostream & out) {
 
         for (Function * F : p.functions) {
 
@@ -245,5 +240,13 @@ namespace LB {
         }
 
     }
+
+    void generateCode(Program & p) {
+
+        std::ofstream out =  std::ofstream();
+        out.open("prog.a");
+
+        generateCode(p, out);
+    }
 }
 
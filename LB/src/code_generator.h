@@ -15,6 +15,7 @@
 namespace LB {
 
     void generateCode(Program & p);
+    void generateCode(Program & p, std::ostream & out);
 
     class InstLBGenVisitor  : public InstVisitor {
         public:
@@ -36,12 +37,12 @@ namespace LB {
             void visit(Instruction_scope *)         override;
 
             InstLBGenVisitor(
-                std::ofstream *out,
+                std::ostream *out,
                 std::map<Instruction_while *, ItemLabel *> * condlb,
                 std::map<Instruction *, Instruction_while *> * inst2loop
             );
         private:
-            std::ofstream *out;
+            std::ostream *out;
 
             std::map<Instruction_while *, ItemLabel *> * condlb;
             std::map<Instruction *, Instruction_while *> * inst2loop;
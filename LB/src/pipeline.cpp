@@ -0,0 +1,17 @@
+#include "pipeline.h"
+#include "parser.h"
+#include "code_generator.h"
+#include "new_label_var.h"
+#include "trans_scope_var.h"
+
+namespace LB {
+
+    void compile_source(const std::string & source, const std::string & sourceName, std::ostream & out){
+        auto p = LB::parse_string(source, sourceName);
+
+        LB::new_var_label_init(p);
+        LB::translate_LB_vars(p);
+        LB::generateCode(p, out);
+    }
+
+}
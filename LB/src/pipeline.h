@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <ostream>
+
+namespace LB {
+
+    /*
+     * Resolve scopes and loops of the LB program held in @source and write the resulting LA program to @out.
+     * Used by the single-process driver; @sourceName is only used in parse errors.
+     */
+    void compile_source(const std::string & source, const std::string & sourceName, std::ostream & out);
+
+}
@@ -0,0 +1,161 @@
+#include <string>
+#include <vector>
+#include <set>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <LB/src/pipeline.h>
+#include <LA/src/pipeline.h>
+#include <IR/src/pipeline.h>
+#include <L3/src/pipeline.h>
+#include <L2/src/pipeline.h>
+#include <L1/src/pipeline.h>
+
+using namespace std;
+
+/**
+ *  One lowering step of the chain: the extension of the language it reads
+ *  and the entry point that translates it into the next language.
+ * */
+struct Stage {
+    std::string ext;
+    void (*compile)(const std::string & source, const std::string & sourceName, std::ostream & out);
+};
+
+static const std::vector<Stage> stages = {
+    {"b",  LB::compile_source},
+    {"a",  LA::compile_source},
+    {"IR", IR::compile_source},
+    {"L3", L3::compile_source},
+    {"L2", L2::compile_source},
+    {"L1", L1::compile_source},
+};
+
+static const std::string TARGET_EXT = "S";
+
+void print_help (char *progName){
+    std::cerr << "Usage: " << progName << " [-v] [-g 0|1] [-O 0|1|2] [-d b|a|IR|L3|L2|L1]... SOURCE" << std::endl;
+    return ;
+}
+
+/**
+ *  index of the stage that reads files with the extension of @fileName, -1 if none
+ * */
+int32_t find_stage(const std::string & fileName) {
+    auto dot = fileName.find_last_of('.');
+    if (dot == std::string::npos) {
+        return -1;
+    }
+    std::string ext = fileName.substr(dot + 1);
+
+    for (int32_t i = 0; i < stages.size(); i++) {
+        if (stages[i].ext == ext) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void write_file(const std::string & fileName, const std::string & content) {
+    std::ofstream outputFile;
+    outputFile.open(fileName);
+    outputFile << content;
+    outputFile.close();
+}
+
+int main(
+    int argc, 
+    char **argv
+    ){
+    auto enable_code_generator = true;
+    int32_t optLevel = 0;
+    bool verbose = false;
+    std::set<std::string> dumpExts;
+
+    /* 
+     * Check the compiler arguments.
+     */
+    if( argc < 2 ) {
+        print_help(argv[0]);
+        return 1;
+    }
+    int32_t opt;
+    while ((opt = getopt(argc, argv, "vg:O:d:")) != -1) {
+        switch (opt){
+            case 'O':
+                optLevel = strtoul(optarg, NULL, 0);
+                break ;
+
+            case 'g':
+                enable_code_generator = (strtoul(optarg, NULL, 0) == 0) ? false : true ;
+                break ;
+
+            case 'd':
+                dumpExts.insert(optarg);
+                break ;
+
+            case 'v':
+                verbose = true;
+                break ;
+
+            default:
+                print_help(argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        print_help(argv[0]);
+        return 1;
+    }
+
+    /*
+     * Pick the first stage from the extension of the source file.
+     */
+    std::string sourceName = argv[optind];
+    int32_t first = find_stage(sourceName);
+    if (first < 0) {
+        std::cerr << "unknown source language: " << sourceName << '\n';
+        return 1;
+    }
+
+    std::ifstream inputFile(sourceName);
+    if (!inputFile) {
+        std::cerr << "cannot open " << sourceName << '\n';
+        return 1;
+    }
+    std::stringstream source;
+    source << inputFile.rdbuf();
+    std::string program = source.str();
+
+    /*
+     * Lower the program stage by stage; every intermediate program stays in memory.
+     */
+    for (int32_t i = first; i < stages.size(); i++) {
+        const std::string & dstExt = (i + 1 < stages.size()) ? stages[i + 1].ext : TARGET_EXT;
+        if (verbose) {
+            std::cerr << "lowering " << stages[i].ext << " -> " << dstExt << '\n';
+        }
+
+        std::ostringstream out;
+        stages[i].compile(program, (i == first) ? sourceName : "prog." + stages[i].ext, out);
+        program = out.str();
+
+        if (dumpExts.count(dstExt) && dstExt != TARGET_EXT) {
+            write_file("prog." + dstExt, program);
+        }
+    }
+
+    /*
+     * Generate x86_64 assembly.
+     */
+    if (enable_code_generator){
+        write_file("prog." + TARGET_EXT, program);
+    }
+
+    return 0;
+}
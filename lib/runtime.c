@@ -21,9 +21,30 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
-#define HEAP_SIZE 1048576    // one megabyte
+#define HEAP_SIZE 1048576    // initial words per semispace (GC_HEAP_WORDS)
 //#define HEAP_SIZE 200      // small heap size for testing
+#define HEAP_MAX_SIZE 268435456 // largest words per semispace (GC_HEAP_MAX_WORDS)
+#define HEAP_GROW_RATIO 2    // grow when more than 1/2 of the heap survives a gc
+#define HEAP_SHRINK_RATIO 8  // shrink when less than 1/8 of the heap survives a gc
+#define NURSERY_SIZE 65536   // words of the nursery (GC_NURSERY_WORDS, 0 disables it)
+#define NURSERY_OBJECT_RATIO 4 // larger objects than 1/4 of the nursery go to the old generation
+#define CARD_TABLE_ADDR 0x40000000 // fixed address of the card table, also known by IR/src/code_generator.cpp
+#define CARD_NUM 65536       // cards in the table, addresses alias modulo CARD_NUM * CARD_BYTES
+#define CARD_SHIFT 9         // cards of 512 bytes (64 words)
+#define GC_BARRIER_FLAG_ADDR (CARD_TABLE_ADDR + CARD_NUM * 8) // set by programs that mark their cards
+#define NURSERY_EXPORT_ADDR (GC_BARRIER_FLAG_ADDR + 8) // top/limit/start bias of the nursery, for inline allocation
+#define LARGE_OBJECT_SIZE 4096 // larger objects go to the large-object space (GC_LARGE_WORDS, 0 disables it)
+#define LARGE_PAGE_WORDS 512 // large objects take whole pages of 4KB
+#define GC_MAX_THREADS 64    // largest number of gc threads (GC_THREADS, default 1)
+#define GC_LAB_WORDS 4096    // to-space words a gc thread claims at a time
+#define GC_STEAL_MAX 256     // largest number of objects stolen at a time
+#define GC_BUSY -2           // header of an object another gc thread is copying
+#define OUTPUT_BUFFER_SIZE 65536 // bytes print() collects before writing them
 //#define GC_DEBUG           // uncomment this to enable GC debugging
 //#define GC_DUMP            // prints the entire heap before/after each gc
 
@@ -31,46 +52,182 @@ typedef struct {
    int64_t *allocptr;           // current allocation position
    int64_t words_allocated;
    void **data;
-   char *valid;
+   uint64_t *starts;            // bit i of starts[i / 64] is set when word i is an object header
 } heap_t;
 
 heap_t heap;      // the current heap
 heap_t heap2;     // the heap for copying
+heap_t nursery;   // young objects, emptied by every gc
+
+// Both semispaces reserve heap_max_size + nursery_size words of address space
+// up front; only the first heap_size words are in use, the rest is never touched
+// (a full gc can copy the nursery on top of a full heap, and a parallel one
+// leaves up to GC_LAB_WORDS unused words per thread)
+int64_t heap_size;
+int64_t heap_min_size;
+int64_t heap_max_size;
+int64_t nursery_size;
+
+// The write barrier of the program stores 1 into the card of
+// every heap word it stores a tuple/tensor into:
+//   card_table[(address >> CARD_SHIFT) % CARD_NUM]
+// Programs that do not set *gc_barrier_flag never use the nursery
+int64_t *card_table;
+int64_t *gc_barrier_flag;
+
+// Programs that set the flag also bump-allocate small objects in place:
+// they claim [top, top + words) when it stays below limit and write the
+// header and the fields themselves, and add the start bit of the header,
+// (address >> 3) % 64, to the bitmap word at ((address >> 9) << 3) + starts_bias
+// themselves. allocate() only runs when the nursery is full
+typedef struct {
+   int64_t *top;
+   int64_t *limit;
+   int64_t starts_bias;
+} nursery_export_t;
+
+nursery_export_t *nursery_export;
+int collect_old;  // does the running gc evacuate heap2 as well
+
+// A gc() with GC_THREADS > 1 runs one worker per thread. Every worker
+// copies into its own chunk of to-space (its lab) and queues the copies
+// whose fields it has not scanned yet; idle workers steal from the queues.
+// An object is claimed by swapping its header for GC_BUSY, the copy
+// then replaces it with -1 and the forwarding address.
+// The words a worker leaves at the end of its labs are 1s without start bits
+typedef struct {
+   int64_t *top;             // free words of the lab
+   int64_t *end;
+   int64_t **queue;          // copied objects whose fields are not scanned yet
+   int64_t queue_len;
+   int64_t queue_cap;
+   pthread_mutex_t lock;     // protects the queue from the thieves
+} gc_worker_t;
+
+// Objects of more than large_size words are never copied: each one takes
+// its own pages of the large-object space, a gc() marks the ones it reaches,
+// scans them in place and gives the pages of the others back
+typedef struct {
+   int64_t *data;
+   int64_t pages;            // reserved pages
+   int64_t top;              // pages ever used, the others are untouched
+   int64_t *runs;            // runs[p] > 0: an object of runs[p] pages starts at page p,
+                             // runs[p] < 0: -runs[p] free pages start at page p, 0 elsewhere
+   char *marks;              // marks[p]: the object at page p was reached by the running gc
+   int64_t words_allocated;  // words of the pages of the objects
+   int64_t limit;            // a gc() runs before words_allocated exceeds it
+} large_space_t;
+
+large_space_t large;
+int64_t large_size;
+
+int64_t gc_threads;
+gc_worker_t gc_workers[GC_MAX_THREADS];
+__thread gc_worker_t *gc_self;   // worker of the running thread, NULL in a serial gc
+int64_t gc_running;              // workers taking part in the gc
+int64_t gc_idle;                 // workers that found no work
 
 int64_t *stack; // pointer to the bottom of the stack (i.e. value
                 // upon program startup)
 
+// The L1 compiler lists the stack slots that are live at every return
+// address of the program (the labels a call returns to and the
+// instruction after each call to allocate), sorted by address.
+// Frames whose return address is missing and everything above them
+// are scanned conservatively; programs without the table have none
+typedef struct {
+   int64_t ret;          // return address
+   int64_t frame_words;  // locals and stack arguments below it
+   int64_t first_slot;   // its slots are gc_stack_map_slots[first_slot, first_slot + slot_num)
+   int64_t slot_num;
+} gc_stack_map_t;
+
+extern const int64_t gc_stack_map_num __attribute__((weak));
+extern const gc_stack_map_t gc_stack_maps[] __attribute__((weak));
+extern const int64_t gc_stack_map_slots[] __attribute__((weak));
+
+/*
+ * print() formats into a private buffer, which is handed to stdout when
+ * it is full, before input() reads, before the runtime reports an error
+ * and on exit; on a terminal every line is handed over as it is printed
+ */
+char output_buffer[OUTPUT_BUFFER_SIZE];
+int64_t output_length;
+int output_line_buffered;
+
+void output_flush() {
+   if(output_length > 0) {
+      fwrite(output_buffer, 1, output_length, stdout);
+      output_length = 0;
+   }
+}
+
+static inline void output_reserve(int64_t bytes) {
+   if(output_length + bytes > OUTPUT_BUFFER_SIZE) {
+      output_flush();
+   }
+}
+
+void output_string(const char *s) {
+   for(; *s != '\0'; s++) {
+      output_reserve(1);
+      output_buffer[output_length++] = *s;
+   }
+}
+
+/*
+ * Decimal digits of n, as printf("%" PRId64) writes them
+ */
+void output_int(int64_t n) {
+   char digits[20];
+   uint64_t u = (n < 0) ? -(uint64_t)n : (uint64_t)n;
+   int i = 0;
+
+   output_reserve(21);
+   if(n < 0) {
+      output_buffer[output_length++] = '-';
+   }
+   do {
+      digits[i++] = '0' + u % 10;
+      u /= 10;
+   } while(u != 0);
+   while(i > 0) {
+      output_buffer[output_length++] = digits[--i];
+   }
+}
+
 /*
  * Helper for the print() function
  */
 void print_content(int64_t *in, int depth) {
    if(depth >= 4) {
-     printf("...");
+     output_string("...");
      return;
    }
    // NOTE: this function crashes quite messily if "in" is 0
    // so we've added this check
    if(in == NULL) {
-     printf("nil");
+     output_string("nil");
      return;
    }
    int64_t x = (int64_t)in;
    if(x & 1) {
-     printf("%" PRId64, x >> 1);
+     output_int(x >> 1);
    } else {
      int64_t size = *((int64_t*)in);
      int64_t *data = in + 1;
      int i;
-     printf("{s:%" PRId64, size);
+     output_string("{s:");
+     output_int(size);
      for(i = 0; i < size; i++) {
-       printf(", ");
+       output_string(", ");
        print_content((int64_t *)(*data), depth + 1);
        data++;
      }
-     printf("}");
+     output_string("}");
      // check for bad pointers
      if (size==-1) {
-       printf("\nfound -1 in an array; internal GC failure\n");
+       output_string("\nfound -1 in an array; internal GC failure\n");
        exit(-1);
      }
    }
@@ -81,7 +238,10 @@ void print_content(int64_t *in, int depth) {
  */
 int64_t print(void *l) {
    print_content(l, 0);
-   printf("\n");
+   output_string("\n");
+   if(output_line_buffered) {
+      output_flush();
+   }
 
    return 1;
 }
@@ -91,120 +251,799 @@ void reset_heap(heap_t *h) {
    h->words_allocated = 0;
 }
 
-int alloc_heap(heap_t *h) {
-   h->data = (void*)malloc(HEAP_SIZE * sizeof(void*));
-   h->valid = (void*)malloc(HEAP_SIZE * sizeof(char));
+/*
+ * Reserves words for h; the kernel only backs
+ * the pages that get used
+ */
+int alloc_heap(heap_t *h, int64_t words) {
+   int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+
+   h->data = mmap(NULL, words * sizeof(void*), PROT_READ | PROT_WRITE, flags, -1, 0);
+   h->starts = mmap(NULL, (words / 64 + 1) * sizeof(uint64_t), PROT_READ | PROT_WRITE, flags, -1, 0);
    reset_heap(h);
-   return (h->data != NULL && h->valid != NULL);
+   return (h->data != MAP_FAILED && h->starts != MAP_FAILED);
+}
+
+/*
+ * Gives the pages of h between from and to (in words) back to the kernel
+ */
+void release_heap(heap_t *h, int64_t from, int64_t to) {
+   // the bitmap pages that only hold bits of [from, to)
+   int64_t page = sysconf(_SC_PAGESIZE);
+   char *first = (char*)(((int64_t)(h->starts + (from + 63) / 64) + page - 1) / page * page);
+   char *last = (char*)((int64_t)(h->starts + to / 64) / page * page);
+
+   madvise(h->data + from, (to - from) * sizeof(void*), MADV_DONTNEED);
+   if(first < last) {
+      madvise(first, last - first, MADV_DONTNEED);
+   }
+}
+
+/*
+ * Object-start bitmap helpers, i is the index of a word of h
+ */
+static inline void set_start(heap_t *h, int64_t i) {
+   h->starts[i / 64] |= (uint64_t)1 << (i % 64);
+}
+
+static inline int is_start(heap_t *h, int64_t i) {
+   return (h->starts[i / 64] >> (i % 64)) & 1;
+}
+
+/*
+ * Clears the start bits of the words [0, to) of h, a word of the bitmap at a time
+ */
+void clear_starts(heap_t *h, int64_t to) {
+   memset(h->starts, 0, (to + 63) / 64 * sizeof(uint64_t));
+}
+
+/*
+ * Adapts heap_size to the survival rate of the gc() that just ran:
+ * doubles it while more than 1/HEAP_GROW_RATIO of it is live (or the
+ * pending allocation of request words does not fit), and halves it
+ * down to the initial size when less than 1/HEAP_SHRINK_RATIO is live
+ */
+void resize_heap(int64_t request) {
+   // the large objects are live data as well, though never copied
+   int64_t live = heap.words_allocated + large.words_allocated + request;
+   int64_t new_size = heap_size;
+
+   while(new_size < heap_max_size &&
+         (live * HEAP_GROW_RATIO > new_size || live >= new_size)) {
+      new_size = (new_size * 2 < heap_max_size) ? new_size * 2 : heap_max_size;
+   }
+
+   if(new_size == heap_size &&
+      heap_size / 2 >= heap_min_size &&
+      live * HEAP_SHRINK_RATIO < heap_size) {
+      new_size = heap_size / 2;
+      release_heap(&heap, new_size, heap_size);
+      release_heap(&heap2, new_size, heap_size);
+   }
+
+#ifdef GC_DEBUG
+   if(new_size != heap_size) {
+      printf("heap resized from %" PRId64 " to %" PRId64 " words\n", heap_size, new_size);
+   }
+#endif
+
+   heap_size = new_size;
+}
+
+/*
+ * Reads a number of at least min from the environment variable name
+ */
+int64_t env_number(const char *name, int64_t default_value, int64_t min) {
+   char *value = getenv(name);
+   char *end;
+   int64_t number;
+
+   if(value == NULL || *value == '\0') {
+      return default_value;
+   }
+
+   number = strtoll(value, &end, 10);
+   if(*end != '\0' || number < min) {
+      printf("%s must be a number >= %" PRId64 ", got \"%s\"\n", name, min, value);
+      exit(-1);
+   }
+   return number;
+}
+
+/*
+ * Maps the card table and the barrier flag at the addresses
+ * the compiled write barriers use
+ */
+int alloc_card_table() {
+   int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE;
+   int64_t bytes = CARD_NUM * sizeof(int64_t) + sizeof(int64_t) + sizeof(nursery_export_t);
+   void *table = mmap((void*)CARD_TABLE_ADDR, bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+
+   card_table = (int64_t*)CARD_TABLE_ADDR;
+   gc_barrier_flag = (int64_t*)GC_BARRIER_FLAG_ADDR;
+   nursery_export = (nursery_export_t*)NURSERY_EXPORT_ADDR;
+   return table == (void*)CARD_TABLE_ADDR;
+}
+
+/*
+ * Hands the free space of the nursery to the inline allocations
+ * of the program; a disabled nursery has none
+ */
+void export_nursery() {
+   nursery_export->top = nursery.allocptr;
+   nursery_export->limit = (int64_t*)nursery.data + nursery_size;
+   nursery_export->starts_bias = (int64_t)nursery.starts - (((int64_t)nursery.data >> 9) << 3);
+}
+
+/*
+ * Takes back the objects the program allocated in place
+ */
+void import_nursery() {
+   nursery.allocptr = nursery_export->top;
+   nursery.words_allocated = nursery.allocptr - (int64_t*)nursery.data;
+}
+
+/*
+ * Empties the nursery; its start bits are cleared because
+ * allocations only set the one of the header
+ */
+void reset_nursery() {
+   clear_starts(&nursery, nursery.words_allocated);
+   reset_heap(&nursery);
+}
+
+int generational() {
+   return nursery_size > 0 && *gc_barrier_flag;
+}
+
+int in_heap(heap_t *h, int64_t *p) {
+   return (void**)p >= h->data && (void**)p < h->data + h->words_allocated;
+}
+
+/*
+ * Marks the cards of the words [from, to), for objects
+ * that get nursery pointers without a write barrier
+ */
+void mark_cards(int64_t *from, int64_t *to) {
+   uint64_t card;
+
+   for(card = (uint64_t)from >> CARD_SHIFT; card <= ((uint64_t)to - 1) >> CARD_SHIFT; card++) {
+      card_table[card % CARD_NUM] = 1;
+   }
+}
+
+/*
+ * Reserves words for the large-object space
+ */
+int alloc_large_space(int64_t words) {
+   int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+
+   large.pages = words / LARGE_PAGE_WORDS + 1;
+   large.data = mmap(NULL, large.pages * LARGE_PAGE_WORDS * sizeof(int64_t), PROT_READ | PROT_WRITE, flags, -1, 0);
+   large.runs = mmap(NULL, large.pages * sizeof(int64_t), PROT_READ | PROT_WRITE, flags, -1, 0);
+   large.marks = mmap(NULL, large.pages, PROT_READ | PROT_WRITE, flags, -1, 0);
+   large.top = 0;
+   large.words_allocated = 0;
+   large.limit = heap_min_size;
+   return (large.data != MAP_FAILED && large.runs != MAP_FAILED && large.marks != MAP_FAILED);
+}
+
+/*
+ * First-fit allocation of the pages of an object of words words,
+ * NULL when the space is exhausted
+ */
+int64_t *alloc_large(int64_t words) {
+   int64_t pages = (words + LARGE_PAGE_WORDS - 1) / LARGE_PAGE_WORDS;
+   int64_t p;
+
+   for(p = 0; p < large.top; p += (large.runs[p] > 0) ? large.runs[p] : -large.runs[p]) {
+      if(-large.runs[p] >= pages) {
+         if(-large.runs[p] > pages) {
+            large.runs[p + pages] = large.runs[p] + pages;
+         }
+         break;
+      }
+   }
+   if(p == large.top) {
+      if(large.top + pages > large.pages) {
+         return NULL;
+      }
+      large.top += pages;
+   }
+
+   large.runs[p] = pages;
+   large.words_allocated += pages * LARGE_PAGE_WORDS;
+   return large.data + p * LARGE_PAGE_WORDS;
+}
+
+int is_large_object(int64_t *p) {
+   int64_t offset;
+
+   if(p < large.data || p >= large.data + large.top * LARGE_PAGE_WORDS) {
+      return 0;
+   }
+   offset = p - large.data;
+   return offset % LARGE_PAGE_WORDS == 0 && large.runs[offset / LARGE_PAGE_WORDS] > 0;
+}
+
+/*
+ * Marks the large object obj, returns 1 if it was not marked yet
+ */
+int mark_large(int64_t *obj) {
+   char *mark = &large.marks[(obj - large.data) / LARGE_PAGE_WORDS];
+
+   return __atomic_exchange_n(mark, 1, __ATOMIC_RELAXED) == 0;
+}
+
+/*
+ * Frees the large objects the gc() that just ran did not mark,
+ * merging the free runs, and clears the marks of the others
+ */
+void sweep_large() {
+   int64_t p, pages, free_run = -1;
+
+   for(p = 0; p < large.top; p += pages) {
+      pages = (large.runs[p] > 0) ? large.runs[p] : -large.runs[p];
+      if(large.runs[p] > 0 && large.marks[p]) {
+         large.marks[p] = 0;
+         free_run = -1;
+         continue;
+      }
+
+      if(large.runs[p] > 0) {
+         madvise(large.data + p * LARGE_PAGE_WORDS, pages * LARGE_PAGE_WORDS * sizeof(int64_t), MADV_DONTNEED);
+         large.words_allocated -= pages * LARGE_PAGE_WORDS;
+      }
+      if(free_run >= 0) {
+         large.runs[free_run] -= pages;
+         large.runs[p] = 0;
+      } else {
+         large.runs[p] = -pages;
+         free_run = p;
+      }
+   }
+
+   // a free run at the end is untouched again
+   if(free_run >= 0) {
+      large.runs[free_run] = 0;
+      large.top = free_run;
+   }
+
+   large.limit = large.words_allocated * HEAP_GROW_RATIO;
+   if(large.limit < heap_min_size) {
+      large.limit = heap_min_size;
+   }
 }
 
 void switch_heaps() {
    int64_t *temp_allocptr = heap.allocptr;
-   int temp_words_allocated = heap.words_allocated;
+   int64_t temp_words_allocated = heap.words_allocated;
    void **temp_data = heap.data;
-   char *temp_valid = heap.valid;
+   uint64_t *temp_starts = heap.starts;
 
    heap.allocptr = heap2.allocptr;
    heap.words_allocated = heap2.words_allocated;
    heap.data = heap2.data;
-   heap.valid = heap2.valid;
+   heap.starts = heap2.starts;
 
    heap2.allocptr = temp_allocptr;
    heap2.words_allocated = temp_words_allocated;
    heap2.data = temp_data;
-   heap2.valid = temp_valid;
+   heap2.starts = temp_starts;
 
    reset_heap(&heap);
 }
 
+int64_t *gc_copy_parallel(gc_worker_t *w, int64_t *old_array);
+void gc_push(gc_worker_t *w, int64_t *obj);
+int64_t *gc_pop(gc_worker_t *w);
+
 /*
  * Helper for the gc() function.
- * Copies (compacts) an object from the old heap into
- * the empty heap
+ * Copies an object from the old heap to the end of the new heap
+ * and leaves a forwarding pointer behind. The fields of the copy
+ * still point into the old heap until gc_scan() reaches them.
  */
 int64_t *gc_copy(int64_t *old)  {
-   int i, size, array_size;
-   int64_t *old_array, *new_array, *first_array_location;
-   int valid_index;
-   char is_valid;
-   char *valid;
-
-   // If not a pointer or not a pointer to a heap location, return input value
-   if((int64_t)old % 8 != 0 ||
-      (void**)old < heap2.data ||
-      (void**)old >= heap2.data + heap2.words_allocated) {
+   int64_t size, array_size, start_index;
+   int64_t *old_array, *new_array;
+   heap_t *from;
+
+   // If not a pointer or not a pointer to a heap location that is being
+   // collected, return input value
+   if((int64_t)old % 8 != 0) {
+      return old;
+   }
+   if(in_heap(&nursery, old)) {
+      from = &nursery;
+   } else if(collect_old && in_heap(&heap2, old)) {
+      from = &heap2;
+   } else {
+      // large objects stay, their fields are scanned from the queue of a worker
+      if(collect_old && is_large_object(old) && mark_large(old)) {
+         gc_push((gc_self != NULL) ? gc_self : &gc_workers[0], old);
+      }
       return old;
    }
    
    // if not pointing at a valid heap object, return input value
-   valid_index = (int64_t)((void**)old - heap2.data);
-   is_valid = heap2.valid[valid_index];
-   if(!is_valid) {
+   start_index = (int64_t)((void**)old - from->data);
+   if(!is_start(from, start_index)) {
       return old;
    }
 
    old_array = (int64_t*)old;
+   if(gc_self != NULL) {
+      return gc_copy_parallel(gc_self, old_array);
+   }
    size = old_array[0];
-   array_size = size + 1;
 
    // If the size is negative, the array has already been copied to the
    // new heap, so the first location of array will contain the new address
    if(size == -1) {
        return (int64_t*)old_array[1];
    }
+
    // If the size is zero, we still have one word of data to copy to the
    // new heap
-   else if(size == 0) {
-       array_size = 2;
-   }
+   array_size = (size == 0) ? 2 : size + 1;
 
 #ifdef GC_DEBUG
-   // printf("gc_copy(): valid=%d old=%p new=%p: size=%d asize=%d total=%d\n", is_valid, old, heap.allocptr, size, array_size, heap.words_allocated);
+   // printf("gc_copy(): old=%p new=%p: size=%" PRId64 " total=%" PRId64 "\n", old, heap.allocptr, size, heap.words_allocated);
 #endif
 
-   valid = heap.valid + heap.words_allocated;
-
-   // Mark the old array as invalid, create the new array
-   old_array[0] = -1;
+   set_start(&heap, heap.words_allocated);
    new_array = heap.allocptr;
    heap.allocptr += array_size;
    heap.words_allocated += array_size;
 
-   // The value of old_array[1] needs to be handled specially
-   // since it holds a pointer to the new heap object
-   first_array_location = (int64_t*)old_array[1];
+   memcpy(new_array, old_array, array_size * sizeof(int64_t));
+
+   // Mark the old array as invalid, its second word
+   // now holds the address of the new array
+   old_array[0] = -1;
    old_array[1] = (int64_t)new_array;
 
-   // Set the values of new_array handling the first two locations separately
-   new_array[0] = size;
-   new_array[1] = (int64_t)gc_copy(first_array_location);
+   return new_array;
+}
+
+/*
+ * Copies the objects the fields of obj refer to
+ */
+void gc_scan_object(int64_t *obj) {
+   int64_t i;
+   int64_t array_size = (obj[0] == 0) ? 2 : obj[0] + 1;
+
+   for(i = 1; i < array_size; i++) {
+      obj[i] = (int64_t)gc_copy((int64_t*)obj[i]);
+   }
+}
+
+/*
+ * Helper for the gc() function.
+ * Cheney scan: the objects of the new heap between scan and
+ * the allocation pointer are the queue of objects whose fields
+ * have not been copied yet, so no recursion is needed.
+ * The large objects gc_copy() marks wait in the queue of the first worker
+ */
+void gc_scan(int64_t *scan) {
+   int64_t i, size, array_size;
+   int64_t *obj;
+
+   do {
+      while(scan < heap.allocptr) {
+         size = scan[0];
+         array_size = (size == 0) ? 2 : size + 1;
+
+         for (i = 1; i < array_size; i++) {
+            scan[i] = (int64_t)gc_copy((int64_t*)scan[i]);
+         }
+         scan += array_size;
+      }
+
+      obj = gc_pop(&gc_workers[0]);
+      if(obj != NULL) {
+         gc_scan_object(obj);
+      }
+   } while(obj != NULL);
+}
+
+/*
+ * Helper for the minor_gc() function.
+ * Copies the nursery objects referenced by the words of the old
+ * generation below limit whose cards are dirty, and cleans every card
+ */
+void gc_scan_cards(int64_t *limit) {
+   uint64_t base = (uint64_t)heap.data >> CARD_SHIFT;
+   uint64_t end = ((uint64_t)limit + (1 << CARD_SHIFT) - 1) >> CARD_SHIFT;
+   uint64_t card, headers;
+   int64_t *word, *from, *to;
+
+   for(card = base; card < end && card < base + CARD_NUM; card++) {
+      if(!card_table[card % CARD_NUM]) {
+         continue;
+      }
+
+      // every card of the heap that shares this entry may be dirty
+      for(uint64_t alias = card; alias < end; alias += CARD_NUM) {
+         from = (int64_t*)(alias << CARD_SHIFT);
+         to = (int64_t*)((alias + 1) << CARD_SHIFT);
+         if(from < (int64_t*)heap.data) from = (int64_t*)heap.data;
+         if(to > limit) to = limit;
+
+         // a card is one word of the bitmap,
+         // object headers are sizes, not references
+         headers = heap.starts[(from - (int64_t*)heap.data) / 64];
+         for(word = from; word < to; word++) {
+            if(!((headers >> ((word - (int64_t*)heap.data) % 64)) & 1)) {
+               *word = (int64_t)gc_copy((int64_t*)*word);
+            }
+         }
+      }
+   }
+
+   memset(card_table, 0, CARD_NUM * sizeof(int64_t));
+}
 
-   valid[0] = 1;
-   valid[1] = 0;
+/*
+ * Helper for the minor_gc() function.
+ * Copies the nursery objects referenced by the words of the
+ * large objects whose cards are dirty; gc_scan_cards() cleans them
+ */
+void gc_scan_large_cards() {
+   int64_t p, pages;
+   int64_t *word, *end, *card_end;
+
+   for(p = 0; p < large.top; p += pages) {
+      pages = (large.runs[p] > 0) ? large.runs[p] : -large.runs[p];
+      if(large.runs[p] < 0) {
+         continue;
+      }
 
-   // Call gc_copy on the remaining values of the array
-   for (i = 2; i < array_size; i++) {
-      new_array[i] = (int64_t)gc_copy((int64_t*)old_array[i]);
-      valid[i] = 0;
+      word = large.data + p * LARGE_PAGE_WORDS;
+      end = word + word[0] + 1;
+      for(word++; word < end; word = card_end) {
+         card_end = (int64_t*)((((uint64_t)word >> CARD_SHIFT) + 1) << CARD_SHIFT);
+         if(card_end > end) {
+            card_end = end;
+         }
+         if(card_table[((uint64_t)word >> CARD_SHIFT) % CARD_NUM]) {
+            for(; word < card_end; word++) {
+               *word = (int64_t)gc_copy((int64_t*)*word);
+            }
+         }
+      }
    }
+}
 
+/*
+ * Stack map of the return address ret, NULL if there is none
+ */
+const gc_stack_map_t *find_stack_map(int64_t ret) {
+   int64_t lo = 0, hi;
+
+   if(&gc_stack_map_num == NULL) {
+      return NULL;
+   }
+   hi = gc_stack_map_num;
+   while(lo < hi) {
+      int64_t mid = lo + (hi - lo) / 2;
+      if(gc_stack_maps[mid].ret < ret) {
+         lo = mid + 1;
+      } else {
+         hi = mid;
+      }
+   }
+   if(lo < gc_stack_map_num && gc_stack_maps[lo].ret == ret) {
+      return &gc_stack_maps[lo];
+   }
+   return NULL;
+}
+
+/*
+ * Copies the objects the stack refers to; rsp is the stack pointer of
+ * the allocate() stub, which saved the callee-save registers below the
+ * return address into the program
+ */
+void gc_scan_stack(int64_t *rsp) {
+   int64_t *frame;
+   int64_t i;
+
+   // the registers may hold anything
+   for(frame = rsp; frame < rsp + 6; frame++) {
+      *frame = (int64_t)gc_copy((int64_t*)*frame);
+   }
+
+   // frame points to a return address, the frame it returns to is above it
+   while(frame < stack) {
+      const gc_stack_map_t *map = find_stack_map(*frame);
+      if(map == NULL) {
+         break;
+      }
+      frame++;
+      for(i = 0; i < map->slot_num; i++) {
+         int64_t *slot = frame + gc_stack_map_slots[map->first_slot + i];
+         *slot = (int64_t)gc_copy((int64_t*)*slot);
+      }
+      frame += map->frame_words;
+   }
+
+   for(; frame <= stack; frame++) {
+      *frame = (int64_t)gc_copy((int64_t*)*frame);
+   }
+}
+
+/*
+ * Gives the free words of the lab of w up: they are filled with
+ * encoded integers, which the card scan of the old generation skips
+ */
+void gc_close_lab(gc_worker_t *w) {
+   for(; w->top < w->end; w->top++) {
+      *w->top = 1;
+   }
+}
+
+/*
+ * Claims words of to-space for worker w and marks the first one as
+ * an object start; objects larger than a quarter of a lab get their own words
+ */
+int64_t *gc_claim(gc_worker_t *w, int64_t words) {
+   int64_t *ret;
+   int64_t index;
+
+   if(w->top + words > w->end) {
+      if(words > GC_LAB_WORDS / 4) {
+         index = __atomic_fetch_add(&heap.words_allocated, words, __ATOMIC_RELAXED);
+         __atomic_fetch_or(&heap.starts[index / 64], (uint64_t)1 << (index % 64), __ATOMIC_RELAXED);
+         return (int64_t*)heap.data + index;
+      }
+      gc_close_lab(w);
+      index = __atomic_fetch_add(&heap.words_allocated, GC_LAB_WORDS, __ATOMIC_RELAXED);
+      w->top = (int64_t*)heap.data + index;
+      w->end = w->top + GC_LAB_WORDS;
+   }
+
+   ret = w->top;
+   w->top += words;
+   index = ret - (int64_t*)heap.data;
+   __atomic_fetch_or(&heap.starts[index / 64], (uint64_t)1 << (index % 64), __ATOMIC_RELAXED);
+   return ret;
+}
+
+void gc_push(gc_worker_t *w, int64_t *obj) {
+   pthread_mutex_lock(&w->lock);
+   if(w->queue_len == w->queue_cap) {
+      w->queue_cap = (w->queue_cap == 0) ? 1024 : w->queue_cap * 2;
+      w->queue = realloc(w->queue, w->queue_cap * sizeof(int64_t*));
+      if(w->queue == NULL) {
+         output_flush();
+      printf("out of memory\n");
+         exit(-1);
+      }
+   }
+   w->queue[w->queue_len] = obj;
+   __atomic_store_n(&w->queue_len, w->queue_len + 1, __ATOMIC_RELEASE);
+   pthread_mutex_unlock(&w->lock);
+}
+
+int64_t *gc_pop(gc_worker_t *w) {
+   int64_t *obj = NULL;
+
+   pthread_mutex_lock(&w->lock);
+   if(w->queue_len > 0) {
+      obj = w->queue[w->queue_len - 1];
+      __atomic_store_n(&w->queue_len, w->queue_len - 1, __ATOMIC_RELEASE);
+   }
+   pthread_mutex_unlock(&w->lock);
+   return obj;
+}
+
+/*
+ * Moves up to half of the queue of another worker to the queue of w,
+ * returns 0 if every other queue is empty
+ */
+int gc_steal(gc_worker_t *w) {
+   int64_t *stolen[GC_STEAL_MAX];
+   int64_t self = w - gc_workers;
+   int64_t i, j, n;
+
+   for(i = 1; i < gc_running; i++) {
+      gc_worker_t *victim = &gc_workers[(self + i) % gc_running];
+
+      if(__atomic_load_n(&victim->queue_len, __ATOMIC_ACQUIRE) == 0) {
+         continue;
+      }
+      pthread_mutex_lock(&victim->lock);
+      n = (victim->queue_len + 1) / 2;
+      if(n > GC_STEAL_MAX) {
+         n = GC_STEAL_MAX;
+      }
+      for(j = 0; j < n; j++) {
+         stolen[j] = victim->queue[victim->queue_len - n + j];
+      }
+      __atomic_store_n(&victim->queue_len, victim->queue_len - n, __ATOMIC_RELEASE);
+      pthread_mutex_unlock(&victim->lock);
+
+      for(j = 0; j < n; j++) {
+         gc_push(w, stolen[j]);
+      }
+      if(n > 0) {
+         return 1;
+      }
+   }
+   return 0;
+}
+
+/*
+ * Parallel gc_copy(): the thread that swaps the header of old_array
+ * for GC_BUSY copies it, the others wait for the forwarding address
+ */
+int64_t *gc_copy_parallel(gc_worker_t *w, int64_t *old_array) {
+   int64_t size = __atomic_load_n(&old_array[0], __ATOMIC_ACQUIRE);
+   int64_t array_size;
+   int64_t *new_array;
+
+   while(1) {
+      if(size == -1) {
+         return (int64_t*)__atomic_load_n(&old_array[1], __ATOMIC_RELAXED);
+      }
+      if(size == GC_BUSY) {
+         sched_yield();
+         size = __atomic_load_n(&old_array[0], __ATOMIC_ACQUIRE);
+         continue;
+      }
+      // on failure size is reloaded
+      if(__atomic_compare_exchange_n(&old_array[0], &size, GC_BUSY, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+         break;
+      }
+   }
+
+   array_size = (size == 0) ? 2 : size + 1;
+   new_array = gc_claim(w, array_size);
+   new_array[0] = size;
+   memcpy(new_array + 1, old_array + 1, (array_size - 1) * sizeof(int64_t));
+
+   __atomic_store_n(&old_array[1], (int64_t)new_array, __ATOMIC_RELAXED);
+   __atomic_store_n(&old_array[0], -1, __ATOMIC_RELEASE);
+
+   gc_push(w, new_array);
    return new_array;
 }
 
+/*
+ * Some worker still has objects to scan
+ */
+int gc_work_left() {
+   int64_t i;
+
+   for(i = 0; i < gc_running; i++) {
+      if(__atomic_load_n(&gc_workers[i].queue_len, __ATOMIC_ACQUIRE) > 0) {
+         return 1;
+      }
+   }
+   return 0;
+}
+
+/*
+ * Scans the queued objects of a worker, and those it steals, until
+ * every worker is idle; idle workers have empty queues and only
+ * leave the idle state to steal
+ */
+void *gc_work(void *arg) {
+   gc_worker_t *w = (gc_worker_t*)arg;
+   int64_t *obj;
+
+   gc_self = w;
+   while(1) {
+      obj = gc_pop(w);
+      if(obj != NULL) {
+         gc_scan_object(obj);
+         continue;
+      }
+      if(gc_steal(w)) {
+         continue;
+      }
+
+      __atomic_add_fetch(&gc_idle, 1, __ATOMIC_SEQ_CST);
+      while(__atomic_load_n(&gc_idle, __ATOMIC_SEQ_CST) < __atomic_load_n(&gc_running, __ATOMIC_SEQ_CST)) {
+         if(gc_work_left()) {
+            break;
+         }
+         sched_yield();
+      }
+      if(__atomic_load_n(&gc_idle, __ATOMIC_SEQ_CST) >= __atomic_load_n(&gc_running, __ATOMIC_SEQ_CST)) {
+         break;
+      }
+      __atomic_sub_fetch(&gc_idle, 1, __ATOMIC_SEQ_CST);
+   }
+   gc_self = NULL;
+   return NULL;
+}
+
+/*
+ * Copies everything reachable from the stack and fill into the empty
+ * heap with gc_threads threads; the calling thread copies the roots
+ */
+int64_t *gc_parallel(int64_t *rsp, int64_t *fill) {
+   pthread_t threads[GC_MAX_THREADS];
+   int64_t i;
+
+   for(i = 0; i < gc_threads; i++) {
+      gc_workers[i].top = gc_workers[i].end = NULL;
+      gc_workers[i].queue_len = 0;
+   }
+   gc_running = gc_threads;
+   gc_idle = 0;
+
+   gc_self = &gc_workers[0];
+   gc_scan_stack(rsp);
+   fill = gc_copy(fill);
+
+   for(i = 1; i < gc_threads; i++) {
+      if(pthread_create(&threads[i], NULL, gc_work, &gc_workers[i]) != 0) {
+         // the workers that did start are enough
+         break;
+      }
+   }
+   __atomic_store_n(&gc_running, i, __ATOMIC_SEQ_CST);
+   gc_work(&gc_workers[0]);
+   for(i = 1; i < gc_running; i++) {
+      pthread_join(threads[i], NULL);
+   }
+
+   for(i = 0; i < gc_running; i++) {
+      gc_close_lab(&gc_workers[i]);
+   }
+   heap.allocptr = (int64_t*)heap.data + heap.words_allocated;
+   return fill;
+}
+
+/*
+ * Collects the nursery only: its live objects are appended to the
+ * old generation, which the caller made room for. The roots are the
+ * stack, fill and the old objects on dirty cards; returns the new fill
+ */
+int64_t *minor_gc(int64_t *rsp, int64_t *fill) {
+   int64_t *old_end = heap.allocptr;
+#ifdef GC_DEBUG
+   printf("minor GC: promoting from %" PRId64 " words: ", nursery.words_allocated);
+#endif
+
+   collect_old = 0;
+
+   gc_scan_stack(rsp);
+   fill = gc_copy(fill);
+   gc_scan_large_cards();
+   gc_scan_cards(old_end);
+
+   // the promoted objects are the queue of the Cheney scan
+   gc_scan(old_end);
+   reset_nursery();
+
+#ifdef GC_DEBUG
+   printf("promoted %" PRId64 " words\n", (int64_t)(heap.allocptr - old_end));
+#endif
+
+   return fill;
+}
+
 /*
  * Initiates garbage collection
+ * fill is the fill value of the allocation that triggered it,
+ * it is a root as well; returns its new value
+ * The nursery is evacuated as well and the cards are cleaned
  */
-void gc(int64_t *rsp) {
+int64_t *gc(int64_t *rsp, int64_t *fill) {
+#ifdef GC_DEBUG
    int i;
    int stack_size = stack - rsp + 1;       // calculate the stack size
-#ifdef GC_DEBUG
    int prev_words_alloc = heap.words_allocated;
 
    printf("GC: stack=(%p,%p) (size %d): ", rsp, stack, stack_size);
 
 #ifdef GC_DUMP
    printf("\n(");
-   for (i=0;i<HEAP_SIZE;i++) {
+   for (i=0;i<heap_size;i++) {
      if (i != 0) printf (" ");
      printf("(%p %p)\n",&(heap.data[i]),heap.data[i]);
    }
@@ -215,29 +1054,66 @@ void gc(int64_t *rsp) {
    // swap in the empty heap to use for storing
    // compacted objects
    switch_heaps();
+   collect_old = 1;
 
    // NOTE: the edi/esi register contents could also be
    // roots, but these have been placed in the stack
    // by the allocate() assembly function.  Thus,
    // we only need to look at the stack at this point
 
-   // Then, we need to copy anything pointed at
-   // by the stack into our empty heap
-   for(i = 0; i < stack_size; i++) {
-      rsp[i] = (int64_t)gc_copy((int64_t*)rsp[i]);
+   if(gc_threads > 1) {
+      fill = gc_parallel(rsp, fill);
+   } else {
+      // Then, we need to copy anything pointed at
+      // by the stack into our empty heap
+      gc_scan_stack(rsp);
+      fill = gc_copy(fill);
+
+      // Finally, copy everything reachable from the copied objects
+      gc_scan((int64_t*)heap.data);
    }
 
+   // the next gc bump-allocates into heap2 and only sets start bits
+   clear_starts(&heap2, heap2.words_allocated);
+   sweep_large();
+
+   // no old object refers to the nursery any more
+   if(nursery.words_allocated > 0) {
+      reset_nursery();
+      memset(card_table, 0, CARD_NUM * sizeof(int64_t));
+   }
+   collect_old = 0;
+
 #ifdef GC_DEBUG
    printf("reclaimed %d words\n", (prev_words_alloc - heap.words_allocated));
 #ifdef GC_DUMP
    printf("(");
-   for (i=0;i<HEAP_SIZE;i++) {
+   for (i=0;i<heap_size;i++) {
      if (i != 0) printf (" ");
      printf("(%p %p)\n",&(heap.data[i]),heap.data[i]);
    }
    printf(")");
 #endif
 #endif
+
+   return fill;
+}
+
+/*
+ * Collects both generations and adapts the heap to the
+ * survivors, so that request more words fit in the old generation
+ */
+int64_t *full_gc(int64_t *rsp, int64_t *fill, int64_t request) {
+   fill = gc(rsp, fill);
+   resize_heap(request);
+
+   // Check if the garbage collection free enough space for the allocation
+   if(heap.words_allocated + request >= heap_size) {
+      output_flush();
+      printf("out of memory\n");
+      exit(-1);
+   }
+   return fill;
 }
 
 /*
@@ -259,7 +1135,10 @@ asm(
    "movq   %r13,24(%rsp)\n"
    "movq   %r14,32(%rsp)\n"
    "movq   %r15,40(%rsp)\n"
+   "movq   %rsp, %rbx\n"    // L1 code keeps no stack alignment, the C code needs 16 bytes
+   "andq   $-16, %rsp\n"
    "call allocate_helper\n" // make the call
+   "movq   %rbx, %rsp\n"
    "movq   (%rsp),%rbx\n"
    "movq   8(%rsp),%rbp\n"
    "movq   16(%rsp),%r12\n"
@@ -321,11 +1200,12 @@ asm(
  */
 void* allocate_helper(int64_t fw_size, int64_t *fw_fill, int64_t *rsp)
 {
-   int i, data_size, array_size;
-   char *valid;
+   int64_t i, data_size, array_size;
    int64_t *ret;
+   heap_t *h;
 
    if(!(fw_size & 1)) {
+      output_flush();
       printf("allocate called with size input that was not an encoded integer, %" 
 	     PRId64
 	     "\n",
@@ -336,7 +1216,8 @@ void* allocate_helper(int64_t fw_size, int64_t *fw_fill, int64_t *rsp)
    data_size = fw_size >> 1;
 
    if(data_size < 0) {
-      printf("allocate called with size of %i\n", data_size);
+      output_flush();
+      printf("allocate called with size of %" PRId64 "\n", data_size);
       exit(-1);
    }
 
@@ -353,45 +1234,83 @@ void* allocate_helper(int64_t fw_size, int64_t *fw_fill, int64_t *rsp)
 
 
 
-   // Check if the heap has space for the allocation
-   if(heap.words_allocated + array_size >= HEAP_SIZE)
-   {
-      // Garbage collect
-      gc(rsp);
-      // get correct value of fw_fill
-      fw_fill=gc_copy(fw_fill);
+   if(generational()) {
+      import_nursery();
+   }
 
-      // Check if the garbage collection free enough space for the allocation
-      if(heap.words_allocated + array_size >= HEAP_SIZE) {
-         printf("out of memory\n");
+   if(large_size > 0 && array_size > large_size) {
+      if(large.words_allocated + array_size > large.limit) {
+         fw_fill = full_gc(rsp, fw_fill, 0);
+      }
+
+      h = NULL;
+      ret = alloc_large(array_size);
+      if(ret == NULL) {
+         output_flush();
+      printf("out of memory\n");
          exit(-1);
       }
+
+      // an old object filled with a young one
+      if(in_heap(&nursery, fw_fill)) {
+         mark_cards(ret + 1, ret + array_size);
+      }
+   } else if(generational() && array_size <= nursery_size / NURSERY_OBJECT_RATIO) {
+      // Check if the nursery has space for the allocation
+      if(nursery.words_allocated + array_size > nursery_size) {
+         // every nursery object may survive, promote them only if they fit
+         if(heap.words_allocated + nursery.words_allocated >= heap_size) {
+            fw_fill = full_gc(rsp, fw_fill, 0);
+         } else {
+            fw_fill = minor_gc(rsp, fw_fill);
+         }
+      }
+
+      h = &nursery;
+      ret = nursery.allocptr;
+      nursery.allocptr += array_size;
+      nursery.words_allocated += array_size;
+   } else {
+      // Check if the heap has space for the allocation
+      if(heap.words_allocated + array_size >= heap_size) {
+         // Garbage collect, getting the correct value of fw_fill
+         fw_fill = full_gc(rsp, fw_fill, array_size);
+      }
+
+      // Do the allocation
+      h = &heap;
+      ret = heap.allocptr;
+      heap.allocptr += array_size;
+      heap.words_allocated += array_size;
+
+      // an old object filled with a young one
+      if(in_heap(&nursery, fw_fill)) {
+         mark_cards(ret + 1, ret + array_size);
+      }
    }
 
-   // Do the allocation
-   ret = heap.allocptr;
-   valid = heap.valid + heap.words_allocated;
-   heap.allocptr += array_size;
-   heap.words_allocated += array_size;
+   if(generational()) {
+      export_nursery();
+   }
 
    // Set the size of the array to be the desired size
    ret[0] = data_size;
 
-   // record this as a heap object
-   valid[0] = 1;
+   // record this as a heap object, the large-object space knows its objects
+   if(h != NULL) {
+      set_start(h, (void**)ret - h->data);
+   }
 
    // If there is no data, set the value of the array to be a number
    // so it can be properly garbage collected
    if(data_size == 0) {
       ret[1] = 1;
-      valid[1] = 0;
       //printf(" set %p to 1\n", &ret[1]);
       //fflush(stdout);
    } else {
       // Fill the array with the fill value
       for(i = 1; i < array_size; i++) {
          ret[i] = (int64_t)fw_fill;
-         valid[i] = 0;
          //printf(" set %p to %d (%p)", &ret[i], fw_fill, fw_fill);
       }
       //printf("\n");
@@ -406,6 +1325,11 @@ void* allocate_helper(int64_t fw_size, int64_t *fw_fill, int64_t *rsp)
  */
 int array_tensor_error_null (int64_t instructionID){
 
+  /*
+   * The output of the program comes first.
+   */
+  output_flush();
+
   /*
    * Check the inputs.
    */
@@ -428,6 +1352,11 @@ int array_tensor_error_null (int64_t instructionID){
 
 int array_error (int64_t instructionID, int64_t length, int64_t index) {
 
+  /*
+   * The output of the program comes first.
+   */
+  output_flush();
+
   /*
    * Check the inputs.
    */
@@ -471,6 +1400,11 @@ int array_error (int64_t instructionID, int64_t length, int64_t index) {
 
 int tensor_error (int64_t instructionID, int64_t dimension, int64_t length, int64_t index) {
 
+  /*
+   * The output of the program comes first.
+   */
+  output_flush();
+
   /*
    * Check the inputs.
    */
@@ -519,6 +1453,8 @@ int tensor_error (int64_t instructionID, int64_t dimension, int64_t length, int6
 }
 
 int input (void){
+  output_flush();
+
   int n = 0;
 
   int64_t numberSize = 100;
@@ -557,12 +1493,30 @@ int input (void){
  * Program entry-point
  */
 int main() {
-   int b1 = alloc_heap(&heap);
-   int b2 = alloc_heap(&heap2);
+   heap_min_size = env_number("GC_HEAP_WORDS", HEAP_SIZE, 1);
+   heap_max_size = env_number("GC_HEAP_MAX_WORDS", HEAP_MAX_SIZE, 1);
+   nursery_size = env_number("GC_NURSERY_WORDS", NURSERY_SIZE, 0);
+   gc_threads = env_number("GC_THREADS", 1, 1);
+   large_size = env_number("GC_LARGE_WORDS", LARGE_OBJECT_SIZE, 0);
+   if(gc_threads > GC_MAX_THREADS) {
+      gc_threads = GC_MAX_THREADS;
+   }
+   if(heap_max_size < heap_min_size) {
+      heap_max_size = heap_min_size;
+   }
+   heap_size = heap_min_size;
+
+   int b1 = alloc_card_table() && alloc_heap(&nursery, nursery_size > 0 ? nursery_size : 1);
+   int b2 = alloc_heap(&heap, heap_max_size + nursery_size + gc_threads * GC_LAB_WORDS) &&
+            alloc_heap(&heap2, heap_max_size + nursery_size + gc_threads * GC_LAB_WORDS) &&
+            alloc_large_space(large_size > 0 ? heap_max_size : 0);
    if(!b1 || !b2) {
-      printf("malloc failed\n");
+      printf("mmap failed\n");
       exit(-1);
    }
+   export_nursery();
+   output_line_buffered = isatty(STDOUT_FILENO);
+   atexit(output_flush);
 
    // Move esp into the bottom-of-stack pointer.
    // The "go" function's boilerplate, in conjunction